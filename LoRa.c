@@ -1,6 +1,7 @@
 #include "LoRa.h"
 
 #include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -8,15 +9,16 @@
 #include <stdint.h>
 #include <time.h>
 
-#include <applibs/log.h>
-#include <applibs/uart.h>
-#include <applibs/gpio.h>
+#include <applibs/eventloop.h>
 
+#include "eventloop_timer_utilities.h"
 #include "peripheral_utilities.h"
 #include "string_utilities.h"
 
-#include "LoRa_ChipConfig.h"
 #include "LoRa_Hal.h"
+#include "LoRa_Io.h"
+#include "LoRa_Log.h"
+#include "LoRa_Ring.h"
 
 #define LORA_MAC_TX    "mac tx "
 #define LORA_JOIN      "mac join "
@@ -24,388 +26,1408 @@
 #define LORA_RADIO_RX  "radio rx "
 
 /**
- * Timer Limit ( ms ) */
-#define LORA_TIMER_EXPIRED 50000
+ * Response Timeouts ( ms ): immediate answer, then deferred answer of
+ * join / tx ( retransmissions and receive windows included ) */
+#define LORA_TIMEOUT_FIRST  3000
+#define LORA_TIMEOUT_SECOND 50000
 
 /**
- * Command String Max Size */
-#define  LORA_MAX_CMD_SIZE 64
+ * Reset Pulse Width and Boot Banner Deadline, in ms */
+#define LORA_RESET_PULSE    100
+#define LORA_TIMEOUT_BOOT   1000
 
 /**
- * Response String Max Size */
-#define LORA_MAX_RSP_SIZE 20
+ * Command Text Max Size, the buffer less "\r\n" and a terminator */
+#define LORA_MAX_CMD_SIZE ( LORA_MAX_TRANSFER_SIZE - 3 )
 
 /**
- * Data String Max Size */
-#define LORA_MAX_DATA_SIZE 256
-#define LORA_MAX_TRANSFER_SIZE 384
-
-/* Buffers */
-static char            _tx_buffer[ LORA_MAX_TRANSFER_SIZE ];
-static char            _rx_buffer[ LORA_MAX_TRANSFER_SIZE ];
-static uint16_t        _rx_buffer_len;
-
-/* Timer Flags and Counter */
-static bool            _timer_f;
-static bool            _timeout_f;
-static bool            _timer_use_f;
-static uint32_t        _ticker;
-static uint32_t        _timer_max;
+ * Command Engine Phases */
+#define LORA_PHASE_IDLE   0
+#define LORA_PHASE_FIRST  1     /* waiting for ok / immediate error   */
+#define LORA_PHASE_SECOND 2     /* waiting for mac_tx_ok, accepted... */
+#define LORA_PHASE_RESET  3     /* reset line held low                */
+#define LORA_PHASE_BOOT   4     /* waiting for the boot banner        */
+#define LORA_PHASE_FAILED 5     /* not written, fails on the next pass */
 
-/* Process Flags */
-static bool            _rsp_rdy_f;
-static bool            _lora_rdy_f;
+/**
+ * Trace entries of an instance: its number in the high nibble of the event */
+#define LORA_CTX_TRACE( ctx, event, a, b ) \
+    LORA_TRACE( ( event ) | ( ( ctx )->id & 0x0F ) << 4, ( a ), ( b ) )
+
+/*
+ * Response vocabulary, keyed by a perfect hash of the first word:
+ * ( len + 2 * first + 7 * last ) & 31 has no collision over these words.
+ * Re-check the slots when adding one. */
+#define LORA_RSP_HASH( w, len ) \
+    ( ( ( len ) + 2u * ( uint8_t )( w )[ 0 ] + 7u * ( uint8_t )( w )[ ( len ) - 1 ] ) & 31u )
+
+typedef struct {
+    const char  *word;
+    uint8_t     len;
+    lora_rsp_t  type;
+    uint8_t     result;
+} lora_rsp_entry_t;
+
+static const lora_rsp_entry_t _rsp_table[ 32 ] = {
+    [  0 ] = { "mac_paused",                      10, LORA_RSP_MAC_PAUSED,        LORA_ERR_MAC_PAUSED },
+    [  2 ] = { "not_joined",                      10, LORA_RSP_NOT_JOINED,        LORA_ERR_NOT_JOINED },
+    [  4 ] = { "invalid_data_len",                16, LORA_RSP_INVALID_DATA_LEN,  LORA_ERR_INVALID_DATA_LEN },
+    [  6 ] = { "accepted",                         8, LORA_RSP_ACCEPTED,          LORA_OK },
+    [  7 ] = { "frame_counter_err_rejoin_needed", 31, LORA_RSP_FRAME_COUNTER_ERR, LORA_ERR_FRAME_COUNTER },
+    [  8 ] = { "mac_rx",                           6, LORA_RSP_MAC_RX,            LORA_MAC_RX },
+    [ 10 ] = { "denied",                           6, LORA_RSP_DENIED,            LORA_ERR_DENIED },
+    [ 11 ] = { "radio_err",                        9, LORA_RSP_RADIO_ERR,         LORA_ERR_RADIO },
+    [ 13 ] = { "ok",                               2, LORA_RSP_OK,                LORA_OK },
+    [ 15 ] = { "keys_not_init",                   13, LORA_RSP_KEYS_NOT_INIT,     LORA_ERR_KEYS_NOT_INIT },
+    [ 16 ] = { "mac_tx_ok",                        9, LORA_RSP_MAC_TX_OK,         LORA_OK },
+    [ 20 ] = { "radio_rx",                         8, LORA_RSP_RADIO_RX,          LORA_OK },
+    [ 23 ] = { "busy",                             4, LORA_RSP_BUSY,              LORA_ERR_BUSY },
+    [ 24 ] = { "silent",                           6, LORA_RSP_SILENT,            LORA_ERR_SILENT },
+    [ 26 ] = { "invalid_param",                   13, LORA_RSP_INVALID_PARAM,     LORA_ERR_INVALID_PARAM },
+    [ 28 ] = { "radio_tx_ok",                     11, LORA_RSP_RADIO_TX_OK,       LORA_OK },
+    [ 30 ] = { "no_free_ch",                      10, LORA_RSP_NO_FREE_CH,        LORA_ERR_NO_FREE_CH },
+    [ 31 ] = { "mac_err",                          7, LORA_RSP_MAC_ERR,           LORA_ERR_MAC },
+};
+
+/* Boot banners, "<model> <version> <date>" */
+static const char *_banner_table[] = {
+    "RN2483 ",
+    "RN2903 ",
+};
+
+typedef struct {
+    const char      *prefix;
+    uint8_t         len;
+    lora_cmd_kind_t kind;
+} lora_kind_entry_t;
+
+/* First match wins: specific prefixes before their family */
+static const lora_kind_entry_t _kind_table[] = {
+    { "mac tx ",    7, LORA_KIND_MAC_TX   },
+    { "mac join ",  9, LORA_KIND_MAC_JOIN },
+    { "mac set ",   8, LORA_KIND_MAC_SET  },
+    { "mac get ",   8, LORA_KIND_MAC_GET  },
+    { "mac ",       4, LORA_KIND_MAC      },
+    { "radio tx ",  9, LORA_KIND_RADIO_TX },
+    { "radio rx ",  9, LORA_KIND_RADIO_RX },
+    { "radio ",     6, LORA_KIND_RADIO    },
+    { "sys ",       4, LORA_KIND_SYS      },
+};
+
+static lora_cmd_kind_t _lora_kind( const char *cmd )
+{
+    for( size_t i = 0; i < sizeof( _kind_table ) / sizeof( _kind_table[ 0 ] ); i++ )
+    {
+        if( !strncmp( cmd, _kind_table[ i ].prefix, _kind_table[ i ].len ) )
+            return _kind_table[ i ].kind;
+    }
+
+    return LORA_KIND_OTHER;
+}
+
+/*
+ * log2 bucket of a latency in ms. */
+static uint8_t _lora_latency_bucket( uint32_t ms )
+{
+    uint8_t bucket = 0;
+
+    while( ms && bucket < LORA_METRICS_LATENCY_BUCKETS - 1 )
+    {
+        ms >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static uint32_t _lora_rx_overflows( lora_ctx_t *ctx )
+{
+    return atomic_load( &ctx->rx_ring.overflows ) + ctx->rx_line_overflows;
+}
+
+static const char *_lora_skip_spaces( const char *ptr )
+{
+    while( *ptr == ' ' )
+        ptr++;
+
+    return ptr;
+}
+
+/*
+ * Classifies the completed line once, filling ctx->rsp with views into
+ * ctx->rx_buffer. Returns the result code of the line. */
+static uint8_t _lora_classify( lora_ctx_t *ctx )
+{
+    const lora_rsp_entry_t *entry = NULL;
+    const char *ptr;
+
+    ctx->rsp.type       = LORA_RSP_VALUE;
+    ctx->rsp.line       = ctx->rx_buffer;
+    ctx->rsp.line_len   = ctx->rx_buffer_len;
+    ctx->rsp.port       = 0;
+    ctx->rsp.data       = NULL;
+    ctx->rsp.data_len   = 0;
+
+    if( ctx->rx_word_len )
+        entry = &_rsp_table[ LORA_RSP_HASH( ctx->rx_buffer, ctx->rx_word_len ) ];
+
+    if( entry == NULL || entry->len != ctx->rx_word_len ||
+        memcmp( entry->word, ctx->rx_buffer, ctx->rx_word_len ) )
+        return LORA_OK;
+
+    ctx->rsp.type = entry->type;
+
+    if( entry->type == LORA_RSP_MAC_RX || entry->type == LORA_RSP_RADIO_RX )
+    {
+        ptr = _lora_skip_spaces( ctx->rx_buffer + ctx->rx_word_len );
+
+        if( entry->type == LORA_RSP_MAC_RX )
+        {
+            while( *ptr >= '0' && *ptr <= '9' )
+                ctx->rsp.port = ctx->rsp.port * 10 + ( *ptr++ - '0' );
+
+            ptr = _lora_skip_spaces( ptr );
+        }
+
+        ctx->rsp.data       = ptr;
+        ctx->rsp.data_len   = ( uint16_t )( ctx->rx_buffer + ctx->rx_buffer_len - ptr );
+    }
+
+    return entry->result;
+}
+
+/*
+ * Starts the deadline of the current phase. The event loop timer covers
+ * asynchronous commands, blocking waits poll up to ctx->cmd_deadline. */
+static void _lora_arm( lora_ctx_t *ctx, uint32_t timeout_ms )
+{
+    struct timespec delay = { .tv_sec = timeout_ms / 1000,
+                              .tv_nsec = ( long )( timeout_ms % 1000 ) * 1000000 };
+
+    clock_gettime( CLOCK_MONOTONIC, &ctx->cmd_deadline );
+    ctx->cmd_deadline.tv_sec  += delay.tv_sec;
+    ctx->cmd_deadline.tv_nsec += delay.tv_nsec;
+
+    if( ctx->cmd_deadline.tv_nsec >= 1000000000 )
+    {
+        ctx->cmd_deadline.tv_sec++;
+        ctx->cmd_deadline.tv_nsec -= 1000000000;
+    }
+
+    /* A zero delay would disarm the timer instead of firing it */
+    if( !timeout_ms )
+        delay.tv_nsec = 1;
+
+    if( ctx->cmd_timer )
+        SetEventLoopTimerOneShot( ctx->cmd_timer, &delay );
+}
+
+static void _lora_disarm( lora_ctx_t *ctx )
+{
+    if( ctx->cmd_timer )
+        DisarmEventLoopTimer( ctx->cmd_timer );
+}
+
+/*
+ * Append cursor over the command buffer, linear in the command length.
+ * An append that does not fit writes nothing and marks the command,
+ * which is then rejected whole rather than sent truncated. */
+typedef struct {
+    char        *start;
+    char        *pos;
+    size_t      room;           /* command bytes left, terminator excluded */
+    bool        overflow_f;
+} lora_cmd_builder_t;
+
+static void _lora_cmd_begin( lora_ctx_t *ctx, lora_cmd_builder_t *cmd )
+{
+    cmd->start      = ctx->tx_buffer;
+    cmd->pos        = ctx->tx_buffer;
+    cmd->room       = LORA_MAX_CMD_SIZE;
+    cmd->overflow_f = false;
+}
+
+static void _lora_cmd_mem( lora_cmd_builder_t *cmd, const char *data, size_t len )
+{
+    if( cmd->overflow_f || len > cmd->room )
+    {
+        cmd->overflow_f = true;
+        return;
+    }
+
+    memcpy( cmd->pos, data, len );
+    cmd->pos    += len;
+    cmd->room   -= len;
+}
+
+/*
+ * Caller strings are scanned no further than the room left. */
+static void _lora_cmd_str( lora_cmd_builder_t *cmd, const char *str )
+{
+    _lora_cmd_mem( cmd, str, strnlen( str, cmd->room + 1 ) );
+}
+
+static void _lora_cmd_dec( lora_cmd_builder_t *cmd, uint32_t value )
+{
+    char digits[ 10 ];
+    size_t first = sizeof( digits );
+
+    do
+        digits[ --first ] = ( char )( '0' + value % 10 );
+    while( ( value /= 10 ) > 0 );
+
+    _lora_cmd_mem( cmd, digits + first, sizeof( digits ) - first );
+}
+
+static void _lora_cmd_hex( lora_cmd_builder_t *cmd, const uint8_t *data, size_t len )
+{
+    if( cmd->overflow_f || len > cmd->room / 2 )
+    {
+        cmd->overflow_f = true;
+        return;
+    }
+
+    cmd->pos    += hex_encode( cmd->pos, data, len );
+    cmd->room   -= 2 * len;
+}
+
+/*
+ * Gives back a claim whose command was never written. */
+static void _lora_unclaim( lora_ctx_t *ctx )
+{
+    ctx->cmd_phase      = LORA_PHASE_IDLE;
+    ctx->cmd_cb         = NULL;
+    ctx->cmd_context    = NULL;
+    ctx->rdy_f          = true;
+
+    _lora_disarm( ctx );
+}
+
+/*
+ * Terminates the command in place, so the frame goes out in a single
+ * write. Returns false, with the engine released, when it overflowed.
+ * A command that could not be written is accepted and fails with
+ * LORA_ERR_IO from the event loop, like any other completion. */
+static bool _lora_send( lora_ctx_t *ctx, lora_cmd_builder_t *cmd )
+{
+    size_t len = ( size_t )( cmd->pos - cmd->start );
+    bool written_f = true;
+
+    if( cmd->overflow_f )
+    {
+        LORA_LOG_WARN("[WARN] LoRa command longer than %d bytes rejected\n", LORA_MAX_CMD_SIZE);
+        LORA_CTX_TRACE( ctx, LORA_TRACE_REJECT, 0, len );
+        _lora_unclaim( ctx );
+        return false;
+    }
+
+    LORA_LOG_DEBUG("[DEBUG] UART > %.*s\n", ( int )len, cmd->start);
+
+    cmd->pos[ 0 ] = '\r';
+    cmd->pos[ 1 ] = '\n';
+    cmd->pos[ 2 ] = '\0';
+    len += 2;
+
+    /* Assembled in the command buffer, then once more into the ring */
+    ctx->metrics.bytes_copied += ( uint32_t )len;
+
+    ctx->cmd_kind = _lora_kind( cmd->start );
+    clock_gettime( CLOCK_MONOTONIC, &ctx->cmd_start );
+
+    ctx->rx_buffer_len  = 0;
+    ctx->rx_word_len    = 0;
+
+    if( ctx->io_thread_f )
+    {
+        /* A command that timed out may still wait for the worker: one that
+           does not fit whole is not queued at all, never sent truncated */
+        if( ( written_f = LORA_RING_SIZE - lora_ring_used( &ctx->tx_ring ) >= len ) )
+        {
+            lora_ring_push( &ctx->tx_ring, ( uint8_t* )cmd->start, len );
+            lora_io_kick( &ctx->io );
+            ctx->metrics.bytes_copied += ( uint32_t )len;
+        }
+    }
+    else
+        written_f = LoRa_hal_uartWriteBuf( &ctx->hal, ( uint8_t* )cmd->start, len );
+
+    if( !written_f )
+    {
+        LORA_LOG_WARN("[WARN] LoRa command not written\n");
+        LORA_CTX_TRACE( ctx, LORA_TRACE_REJECT, ctx->cmd_kind, len );
+        ctx->cmd_phase = LORA_PHASE_FAILED;
+        _lora_arm( ctx, 0 );
+        return true;
+    }
+
+    ctx->metrics.commands[ ctx->cmd_kind ]++;
+    LORA_CTX_TRACE( ctx, LORA_TRACE_CMD, ctx->cmd_kind, len );
+    ctx->metrics.bytes_out += ( uint32_t )len;
+
+    return true;
+}
+
+/*
+ * Milliseconds left before the deadline, rounded up, or -1 when idle. */
+static int _lora_deadline_ms( lora_ctx_t *ctx )
+{
+    struct timespec now;
+    int64_t left;
+
+    if( ctx->rdy_f )
+        return -1;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    left = ( int64_t )( ctx->cmd_deadline.tv_sec - now.tv_sec ) * 1000 +
+           ( ctx->cmd_deadline.tv_nsec - now.tv_nsec + 999999 ) / 1000000;
+
+    return left > 0 ? ( int )left : 0;
+}
 
-/* Response vars */
-static bool                     _rsp_f;
-static char*                    _rsp_buffer;
-static bool                     _callback_default;
-static struct timespec delay100ms = {.tv_sec = 0, .tv_nsec = 1000 * 1000 * 100};
-static struct timespec delay1sec = {.tv_sec = 1, .tv_nsec = 0};
+/*
+ * Claims the engine for a new command. Must be called before the command
+ * is assembled in ctx->tx_buffer, which belongs to the command in flight. */
+static bool _lora_claim( lora_ctx_t *ctx, bool two_phase, lora_cmd_cb cb, void *context )
+{
+    if( !ctx->rdy_f )
+    {
+        LORA_LOG_DEBUG("[DEBUG] LoRa busy, command rejected\n");
+        return false;
+    }
 
+    ctx->rdy_f          = false;
+    ctx->cmd_phase      = LORA_PHASE_FIRST;
+    ctx->cmd_two_phase  = two_phase;
+    ctx->cmd_cb         = cb;
+    ctx->cmd_context    = context;
 
-static void _delay_100ms(void) {
-    nanosleep(&delay100ms, NULL);
+    _lora_arm( ctx, ctx->timeout_first );
+
+    return true;
 }
 
-static void _delay_1sec(void) {
-    nanosleep(&delay1sec, NULL);
+/*
+ * Decodes a mac_rx payload in place, over its own hex digits, and hands
+ * the bytes to the downlink callback. The hex is gone afterwards: the
+ * view keeps "mac_rx <port>" and no data. */
+static void _lora_downlink( lora_ctx_t *ctx, lora_rsp_view_t *rsp )
+{
+    char *data = ctx->rx_buffer + ( rsp->data - rsp->line );
+    ssize_t len;
+
+    if( !ctx->downlink_cb || !rsp->data )
+        return;
+
+    if( ( len = hex_decode( ( uint8_t* )data, data, rsp->data_len ) ) < 0 )
+    {
+        LORA_LOG_WARN("[WARN] malformed downlink on port %d dropped\n", rsp->port);
+        return;
+    }
+
+    LORA_CTX_TRACE( ctx, LORA_TRACE_DOWNLINK, rsp->port, len );
+    ctx->metrics.bytes_copied += ( uint32_t )len;
+
+    ctx->downlink_cb( rsp->port, ( uint8_t* )data, ( size_t )len, ctx->downlink_context );
+
+    while( data > ctx->rx_buffer && data[ -1 ] == ' ' )
+        data--;
+
+    *data           = '\0';
+    rsp->line_len   = ( uint16_t )( data - ctx->rx_buffer );
+    rsp->data       = NULL;
+    rsp->data_len   = 0;
 }
 
-static void _lora_resp(void)
+static void _lora_metrics_complete( lora_ctx_t *ctx, uint8_t res )
 {
-    _rx_buffer_len  = 0;
-    _lora_rdy_f     = false;
-    _rsp_rdy_f      = false;
-    _rsp_f          = true;
+    struct timespec now;
+    int64_t ms;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    ms = ( int64_t )( now.tv_sec - ctx->cmd_start.tv_sec ) * 1000 +
+         ( now.tv_nsec - ctx->cmd_start.tv_nsec ) / 1000000;
+
+    ctx->metrics.results[ res < LORA_METRICS_RESULTS ? res : LORA_METRICS_RESULTS - 1 ]++;
+    ctx->metrics.latency[ ctx->cmd_kind ][ _lora_latency_bucket( ms > 0 ? ( uint32_t )ms : 0 ) ]++;
+
+    if( ctx->rsp.type == LORA_RSP_ACCEPTED )
+        ctx->metrics.joins_accepted++;
+    else if( ctx->rsp.type == LORA_RSP_MAC_RX )
+        ctx->metrics.downlinks++;
 }
 
-static uint8_t _lora_par(void)
+static void _lora_script_next( lora_ctx_t *ctx );
+
+static void _lora_complete( lora_ctx_t *ctx, uint8_t res )
 {
-    Log_Debug("[DEBUG] _lora_par : %s\n", _rx_buffer);
+    lora_cmd_cb cb      = ctx->cmd_cb;
+    void *context       = ctx->cmd_context;
+    lora_rsp_view_t rsp = ctx->rsp;
+
+    if( ctx->rsp_buffer )
+    {
+        LoRa_hal_gpio_csSet( &ctx->hal, true );
+        memcpy( ctx->rsp_buffer, ctx->rsp.line, ctx->rsp.line_len + 1 );
+        LoRa_hal_gpio_csSet( &ctx->hal, false );
+        ctx->metrics.bytes_copied += ctx->rsp.line_len + 1u;
+        ctx->rsp_buffer = NULL;
+    }
+
+    ctx->cmd_phase      = LORA_PHASE_IDLE;
+    ctx->cmd_cb         = NULL;
+    ctx->cmd_context    = NULL;
+    ctx->rdy_f          = true;
+
+    _lora_disarm( ctx );
+    _lora_metrics_complete( ctx, res );
 
-    if( !strcmp( _rx_buffer, "invalid_param" ) )
-        return 1;
-    if( !strcmp( _rx_buffer, "not_joined" ) )
-        return 2;
-    if( !strcmp( _rx_buffer, "no_free_ch" ) )
-        return 3;
-    if( !strcmp( _rx_buffer, "silent" ) )
-        return 4;
-    if( !strcmp( _rx_buffer, "frame_counter_err_rejoin_needed" ) )
-        return 5;
-    if( !strcmp( _rx_buffer, "busy" ) )
-        return 6;
-    if( !strcmp( _rx_buffer, "mac_paused" ) )
-        return 7;
-    if( !strcmp( _rx_buffer, "invalid_data_len" ) )
-        return 8;
-    if( !strcmp( _rx_buffer, "keys_not_init" ) )
-        return 9;
-    return 0;
+    /* Only mac tx ends on these: the frame went on air, acknowledged or not */
+    if( rsp.type == LORA_RSP_MAC_TX_OK || rsp.type == LORA_RSP_MAC_RX || rsp.type == LORA_RSP_MAC_ERR )
+    {
+        ctx->downlink_pending_f = rsp.type == LORA_RSP_MAC_RX;
+
+        if( ctx->frame_cb )
+            ctx->frame_cb( rsp.type == LORA_RSP_MAC_RX, ctx->frame_context );
+    }
+
+    /* Delivered first, while the receive buffer still holds the payload:
+       a blocking command from the callbacks below reads over it */
+    if( rsp.type == LORA_RSP_MAC_RX )
+        _lora_downlink( ctx, &rsp );
+
+    if( ctx->result_cb )
+        ctx->result_cb( res, &rsp, ctx->result_context );
+
+    /* The callback is free to submit the next command */
+    if( cb )
+        cb( res, &rsp, context );
+
+    /* A script step that found the engine taken goes before the idle hook */
+    if( ctx->rdy_f && ctx->script_wait_f )
+        _lora_script_next( ctx );
+
+    /* Nothing chained from the callbacks: offer the engine to the idle hook */
+    if( ctx->rdy_f && ctx->idle_cb )
+        ctx->idle_cb( ctx->idle_context );
 }
-static uint8_t _lora_repar(void)
+
+/*
+ * Completes the command in flight with an empty response. */
+static void _lora_abort( lora_ctx_t *ctx, uint8_t res )
 {
-    Log_Debug("[DEBUG] _lora_repar : %s\n", _rx_buffer);
+    LORA_CTX_TRACE( ctx, LORA_TRACE_ABORT, res, ctx->cmd_phase );
+
+    ctx->rx_buffer_len      = 0;
+    ctx->rx_word_len        = 0;
+    ctx->rx_buffer[ 0 ]     = '\0';
 
-    if( !strcmp( _rx_buffer, "mac_err" ) )
-        return 10;
-    if( !strcmp( _rx_buffer, "mac_tx_ok" ) )
-        return 0;
-    if( !strcmp( _rx_buffer, "mac_rx" ) )
-        return 12;
-    if( !strcmp( _rx_buffer, "invalid_data_len" ) )
-        return 13;
-    if( !strcmp( _rx_buffer, "radio_err" ) )
-        return 14;
-    if( !strcmp( _rx_buffer, "radio_tx_ok" ) )
-        return 0;
-    if( !strcmp( _rx_buffer, "radio_rx" ) )
-        return 0;
-    if( !strcmp( _rx_buffer, "accepted" ) )
-        return 0;
-    if( !strcmp( _rx_buffer, "denied" ) )
-        return 18;
-    return 0;
+    memset( &ctx->rsp, 0, sizeof( ctx->rsp ) );
+    ctx->rsp.line = ctx->rx_buffer;
+
+    _lora_complete( ctx, res );
 }
 
-static void _lora_write(void)
+/*
+ * Deferred answers can only end a second phase: seen first, they are the
+ * late answer of a command that already timed out. */
+static bool _lora_rsp_deferred( lora_rsp_t type )
 {
-    char *ptr = _tx_buffer;
+    switch( type )
+    {
+    case LORA_RSP_MAC_TX_OK:
+    case LORA_RSP_MAC_RX:
+    case LORA_RSP_MAC_ERR:
+    case LORA_RSP_ACCEPTED:
+    case LORA_RSP_DENIED:
+    case LORA_RSP_RADIO_TX_OK:
+    case LORA_RSP_RADIO_RX:
+    case LORA_RSP_RADIO_ERR:
+        return true;
+    default:
+        return false;
+    }
+}
 
-    Log_Debug("[DEBUG] UART > %s\n", _tx_buffer);
+/*
+ * Advances the response state machine by one complete line. */
+static void _lora_dispatch( lora_ctx_t *ctx )
+{
+    uint8_t res = _lora_classify( ctx );
 
-    while( *ptr )
-        LoRa_hal_uartWrite( *ptr++ );
+    /* A blocking command from a callback assembles the next lines meanwhile */
+    ctx->rx_buffer_len  = 0;
+    ctx->rx_word_len    = 0;
 
-    LoRa_hal_uartWrite( '\r' );
-    LoRa_hal_uartWrite( '\n' );
+    LORA_LOG_DEBUG("[DEBUG] UART < %s\n", ctx->rx_buffer);
+    LORA_CTX_TRACE( ctx, LORA_TRACE_RSP, ctx->rsp.type, res );
 
-    _rx_buffer_len  = 0;
-    _lora_rdy_f     = false;
-    _rsp_rdy_f      = false;
-    _timer_f        = true;
-    _rsp_f          = true;
+    switch( ctx->cmd_phase )
+    {
+    case LORA_PHASE_FIRST:
+        if( _lora_rsp_deferred( ctx->rsp.type ) )
+        {
+            LORA_LOG_DEBUG("[DEBUG] stale response ignored\n");
+            LORA_CTX_TRACE( ctx, LORA_TRACE_STALE, ctx->rsp.type, ctx->cmd_phase );
+        }
+        else if( res || !ctx->cmd_two_phase )
+            _lora_complete( ctx, res );
+        else
+        {
+            ctx->cmd_phase = LORA_PHASE_SECOND;
+            _lora_arm( ctx, ctx->timeout_second );
+        }
+        break;
+
+    case LORA_PHASE_SECOND:
+        _lora_complete( ctx, res );
+        break;
+
+    case LORA_PHASE_BOOT:
+        if( lora_banner( ctx->rx_buffer ) )
+        {
+            LORA_LOG_INFO("[INFO] LoRa module ready: %s\n", ctx->rx_buffer);
+            _lora_complete( ctx, LORA_OK );
+        }
+        else
+            LORA_CTX_TRACE( ctx, LORA_TRACE_STALE, ctx->rsp.type, ctx->cmd_phase );
+        break;
+
+    default:
+        LORA_LOG_DEBUG("[DEBUG] unsolicited response ignored\n");
+        LORA_CTX_TRACE( ctx, LORA_TRACE_STALE, ctx->rsp.type, ctx->cmd_phase );
+        break;
+    }
 }
 
-static void _lora_read(void)
+/*
+ * Line assembler, consumer side of the receive ring. */
+static void _lora_rx_byte( lora_ctx_t *ctx, char rx_input )
 {
-    if( !_rsp_f )
+    /* Bytes were lost in the ring: the line they belonged to is dropped */
+    if( rx_input == LORA_IO_RX_BREAK )
     {
-        LoRa_hal_gpio_csSet( true );
-        LoRa_hal_gpio_csSet( false );
+        if( !ctx->rx_discard_f )
+        {
+            LORA_LOG_WARN("[WARN] UART < receive overflow, line dropped\n");
+            LORA_CTX_TRACE( ctx, LORA_TRACE_LINE_OVERFLOW, 1, ctx->rx_buffer_len );
+            ctx->rx_line_overflows++;
+            ctx->rx_discard_f = true;
+        }
+        return;
+    }
 
-    } 
-    else if( _rsp_f )
+    ctx->metrics.bytes_in++;
+
+    if( rx_input == '\r' )
+        return;
+
+    if( rx_input == '\n' )
     {
-        LoRa_hal_gpio_csSet( true );
-        strcpy( _rsp_buffer, _rx_buffer );
-        LoRa_hal_gpio_csSet( false );
+        ctx->rx_buffer[ ctx->rx_buffer_len ] = '\0';
+
+        if( ctx->rx_discard_f )
+            ctx->rx_discard_f = false;
+        else if( ctx->rx_buffer_len )
+        {
+            if( !ctx->rx_word_len )
+                ctx->rx_word_len = ctx->rx_buffer_len;
+
+            _lora_dispatch( ctx );
+            return;
+        }
+
+        ctx->rx_buffer_len  = 0;
+        ctx->rx_word_len    = 0;
+        return;
     }
 
-    _lora_rdy_f     = true;
-    _rsp_rdy_f      = false;
-    _timer_f        = false;
-    _rsp_f          = true;
+    if( ctx->rx_discard_f )
+        return;
+
+    /* Remember where the first word ends, for classification */
+    if( rx_input == ' ' && !ctx->rx_word_len )
+        ctx->rx_word_len = ctx->rx_buffer_len;
+
+    /* Drop the whole line rather than hand a truncated frame to the parser */
+    if( ctx->rx_buffer_len >= LORA_MAX_LINE_SIZE - 1 )
+    {
+        LORA_LOG_WARN("[WARN] UART < line overflow, dropped\n");
+        LORA_CTX_TRACE( ctx, LORA_TRACE_LINE_OVERFLOW, 0, ctx->rx_buffer_len );
+        ctx->rx_line_overflows++;
+        ctx->rx_discard_f = true;
+        return;
+    }
+
+    ctx->rx_buffer[ ctx->rx_buffer_len++ ] = rx_input;
+    ctx->metrics.bytes_copied++;
+}
+
+/*
+ * Each line leaves the ring before it is dispatched: a blocking command
+ * issued from a callback drains what follows itself. */
+static void _lora_rx_drain( lora_ctx_t *ctx )
+{
+    uint8_t *span;
+    uint8_t *end;
+    size_t len;
+
+    while( ( len = lora_ring_read_span( &ctx->rx_ring, &span ) ) > 0 )
+    {
+        if( ( end = memchr( span, '\n', len ) ) != NULL )
+            len = ( size_t )( end - span );
+
+        for( size_t i = 0; i < len; i++ )
+            _lora_rx_byte( ctx, span[ i ] );
+
+        lora_ring_release( &ctx->rx_ring, end ? len + 1 : len );
+
+        if( end )
+            _lora_rx_byte( ctx, '\n' );
+    }
+}
+
+static void _lora_uart_event( EventLoop *el, int fd, EventLoop_IoEvents events, void *context )
+{
+    lora_process( context );
+}
+
+static void _lora_timer_event( EventLoopTimer *timer )
+{
+    ConsumeEventLoopTimerEvent( timer );
+
+    /* Drains what arrived meanwhile, then expires the deadline if due */
+    lora_process( GetEventLoopTimerContext( timer ) );
+}
+
+/*
+ * Sleeps on the UART, or on the I/O thread, until the flag is raised by a
+ * completed response. */
+static void _lora_wait( lora_ctx_t *ctx, const bool *flag )
+{
+    struct pollfd pfd = { .fd = ctx->io_thread_f ? lora_io_event_fd( &ctx->io ) : LoRa_hal_uartFd( &ctx->hal ),
+                          .events = POLLIN };
+
+    lora_process( ctx );
+
+    while( !*flag )
+    {
+        if( poll( &pfd, 1, _lora_deadline_ms( ctx ) ) < 0 && errno != EINTR )
+        {
+            LORA_LOG_ERROR("ERROR: Could not poll LoRa UART: %s (%d).\n", strerror(errno), errno);
+            return;
+        }
+
+        if( ( pfd.revents & ( POLLERR | POLLHUP | POLLNVAL ) ) || ( ctx->io_thread_f && lora_io_failed( &ctx->io ) ) )
+        {
+            LORA_LOG_ERROR("ERROR: LoRa UART hung up.\n");
+
+            if( !ctx->rdy_f )
+                _lora_abort( ctx, LORA_ERR_TIMEOUT );
+            return;
+        }
+
+        lora_process( ctx );
+    }
+}
+
+static void _lora_sync_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    lora_ctx_t *ctx = context;
+
+    ctx->sync_res       = result;
+    ctx->sync_done_f    = true;
+}
+
+static uint8_t _lora_sync_wait( lora_ctx_t *ctx, char *response )
+{
+    ctx->rsp_buffer = response;
+    _lora_wait( ctx, &ctx->sync_done_f );
+
+    return ctx->sync_res;
+}
+
+static bool _lora_sync_claim( lora_ctx_t *ctx, bool two_phase )
+{
+    _lora_wait( ctx, &ctx->rdy_f );
+
+    ctx->sync_done_f    = false;
+    ctx->sync_res       = 0;
+
+    return _lora_claim( ctx, two_phase, _lora_sync_cb, ctx );
+}
+
+/*
+ * Records the step result and chains the next command straight from the
+ * completion, so the module never waits on the caller between steps. */
+static void _lora_script_step_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    lora_ctx_t *ctx = context;
+    lora_script_step_t *step = &ctx->script_steps[ ctx->script_index++ ];
+    size_t len = rsp->line_len < LORA_SCRIPT_RSP_SIZE - 1 ? rsp->line_len : LORA_SCRIPT_RSP_SIZE - 1;
+
+    step->result = result;
+    memcpy( step->response, rsp->line, len );
+    step->response[ len ] = '\0';
+
+    if( result )
+        ctx->script_failed++;
+
+    if( result == LORA_ERR_CANCELLED )
+        ctx->script_cancel_f = true;
+
+    _lora_script_next( ctx );
+}
+
+static void _lora_script_next( lora_ctx_t *ctx )
+{
+    lora_script_step_t *steps;
+    lora_script_cb cb;
+
+    ctx->script_wait_f = false;
+
+    while( ctx->script_index < ctx->script_count && !ctx->script_cancel_f )
+    {
+        /* Taken from a result hook or callback: its completion resumes the script */
+        if( !ctx->rdy_f )
+        {
+            ctx->script_wait_f = true;
+            return;
+        }
+
+        if( lora_cmd_async( ctx, ctx->script_steps[ ctx->script_index ].cmd, _lora_script_step_cb, ctx ) )
+            return;
+
+        /* Too long for the command buffer, the next steps still run */
+        ctx->script_steps[ ctx->script_index++ ].result = LORA_ERR_INVALID_PARAM;
+        ctx->script_failed++;
+    }
+
+    /* Steps after a cancellation are not run */
+    for( ; ctx->script_index < ctx->script_count; ctx->script_index++ )
+    {
+        ctx->script_steps[ ctx->script_index ].result = LORA_ERR_CANCELLED;
+        ctx->script_failed++;
+    }
+
+    steps   = ctx->script_steps;
+    cb      = ctx->script_cb;
+
+    ctx->script_steps = NULL;
+    ctx->script_cb    = NULL;
+
+    if( cb )
+        cb( steps, ctx->script_count, ctx->script_failed, ctx->script_context );
+}
+
+static void _lora_script_sync_cb( lora_script_step_t *steps, size_t count, size_t failed,
+                                  void *context )
+{
+    lora_ctx_t *ctx = context;
+
+    ctx->sync_done_f = true;
 }
 
 
 /* --------------------------------------------------------- PUBLIC FUNCTIONS */
-void lora_uartDriverInit(void)
+/*
+ * Holds the claimed engine through a reset: the deadline ends the pulse,
+ * then the boot banner, or the boot deadline, completes the command. */
+static void _lora_reset_start( lora_ctx_t *ctx )
 {
-    if (!LoRa_hal_uartMap()) {
+    ctx->rx_buffer_len  = 0;
+    ctx->rx_word_len    = 0;
+    ctx->cmd_kind       = LORA_KIND_SYS;
+    ctx->metrics.commands[ LORA_KIND_SYS ]++;
+    LORA_CTX_TRACE( ctx, LORA_TRACE_CMD, LORA_KIND_SYS, 0 );
+    clock_gettime( CLOCK_MONOTONIC, &ctx->cmd_start );
+
+    LoRa_hal_gpio_rstSet( &ctx->hal, 0 );
+    ctx->cmd_phase = LORA_PHASE_RESET;
+    _lora_arm( ctx, LORA_RESET_PULSE );
+}
+
+void lora_uartDriverInit( lora_ctx_t *ctx, const lora_cfg_t *cfg )
+{
+    if (!LoRa_hal_uartMap( &ctx->hal, &cfg->hal )) {
         return;
     }
     
-    if (!LoRa_hal_gpio_gpioMap()) {
+    if (!LoRa_hal_gpio_gpioMap( &ctx->hal, &cfg->hal )) {
         return;
     }
 
-    Log_Debug("LoRa/UART Driver Initialized...\n");
+    LORA_LOG_INFO("LoRa/UART Driver Initialized...\n");
 }
 
 /* ----------------------------------------------------------- IMPLEMENTATION */
 /******************************************************************************
+*  LoRa CFG SETUP
+*******************************************************************************/
+void lora_cfg_setup( lora_cfg_t *cfg )
+{
+    LoRa_hal_cfgSetup( &cfg->hal );
+}
+/******************************************************************************
 *  LoRa INIT
 *******************************************************************************/
-void lora_init()
-{
-    lora_uartDriverInit();
-
-    LoRa_hal_gpio_rstSet( 1 );
-    _delay_100ms();
-    LoRa_hal_gpio_rstSet( 0 );
-    _delay_100ms();
-    _delay_100ms();
-    _delay_100ms();
-    LoRa_hal_gpio_rstSet( 1 );
-    _delay_100ms();
-    LoRa_hal_gpio_csSet( 1 );
-    
-    memset( _tx_buffer, 0, LORA_MAX_CMD_SIZE + LORA_MAX_DATA_SIZE );
-    memset( _rx_buffer, 0, LORA_MAX_RSP_SIZE + LORA_MAX_DATA_SIZE );
-    
-    _timer_max          = LORA_TIMER_EXPIRED;
-    _rx_buffer_len      = 0;
-    _ticker             = 0;
-    _timer_f            = false;
-    _timeout_f          = false;
-    _timer_use_f        = false;
-    _rsp_f              = false;
-    _rsp_rdy_f          = false;
-    _lora_rdy_f         = true;
-    
-    _delay_1sec();
+void lora_init( lora_ctx_t *ctx, const lora_cfg_t *cfg )
+{
+    static uint8_t instances;
+
+    memset( ctx, 0, sizeof( *ctx ) );
+    ctx->hal.uart_fd    = -1;
+    ctx->hal.rst_fd     = -1;
+    ctx->hal.cs_fd      = -1;
+    ctx->id             = instances++;
+    lora_io_init( &ctx->io );
+
+    lora_uartDriverInit( ctx, cfg );
+    LoRa_hal_gpio_csSet( &ctx->hal, 1 );
+
+    lora_ring_init( &ctx->rx_ring );
+
+    ctx->cmd_phase          = LORA_PHASE_IDLE;
+    ctx->timeout_first      = LORA_TIMEOUT_FIRST;
+    ctx->timeout_second     = LORA_TIMEOUT_SECOND;
+    ctx->rdy_f              = true;
+}
+/******************************************************************************
+*  LoRa ATTACH
+*******************************************************************************/
+bool lora_attach( lora_ctx_t *ctx, EventLoop *event_loop )
+{
+    int fd = ctx->io_thread_f ? lora_io_event_fd( &ctx->io ) : LoRa_hal_uartFd( &ctx->hal );
+
+    ctx->uart_reg = EventLoop_RegisterIo( event_loop, fd, EventLoop_Input, _lora_uart_event, ctx );
+
+    if( ctx->uart_reg == NULL )
+    {
+        LORA_LOG_ERROR("ERROR: Could not register LoRa UART event: %s (%d).\n", strerror(errno), errno);
+        return false;
+    }
+
+    ctx->cmd_timer = CreateEventLoopDisarmedTimer( event_loop, _lora_timer_event );
+
+    if( ctx->cmd_timer == NULL )
+    {
+        EventLoop_UnregisterIo( event_loop, ctx->uart_reg );
+        ctx->uart_reg = NULL;
+        return false;
+    }
+
+    SetEventLoopTimerContext( ctx->cmd_timer, ctx );
+    ctx->event_loop = event_loop;
+
+    return true;
+}
+
+/*
+ * Same as lora_attach, with the UART handed to a radio I/O thread. Must be
+ * called while no command is in flight. */
+bool lora_attach_thread( lora_ctx_t *ctx, EventLoop *event_loop )
+{
+    lora_ring_init( &ctx->tx_ring );
+
+    if( !lora_io_start( &ctx->io, &ctx->hal, &ctx->rx_ring, &ctx->tx_ring ) )
+        return false;
+
+    ctx->io_thread_f = true;
+
+    if( !lora_attach( ctx, event_loop ) )
+    {
+        lora_io_stop( &ctx->io );
+        ctx->io_thread_f = false;
+        return false;
+    }
+
+    return true;
+}
+/******************************************************************************
+*  LoRa DETACH
+*******************************************************************************/
+void lora_detach( lora_ctx_t *ctx )
+{
+    if( ctx->uart_reg == NULL )
+        return;
+
+    DisposeEventLoopTimer( ctx->cmd_timer );
+    EventLoop_UnregisterIo( ctx->event_loop, ctx->uart_reg );
+    ctx->cmd_timer  = NULL;
+    ctx->uart_reg   = NULL;
+    ctx->event_loop = NULL;
+
+    /* The UART goes back to the caller's thread */
+    if( ctx->io_thread_f )
+    {
+        lora_io_stop( &ctx->io );
+        ctx->io_thread_f = false;
+    }
+}
+/******************************************************************************
+*  LoRa BUSY
+*******************************************************************************/
+bool lora_busy( lora_ctx_t *ctx )
+{
+    return !ctx->rdy_f;
+}
+
+/******************************************************************************
+*  LoRa RESET
+*******************************************************************************/
+bool lora_reset_async( lora_ctx_t *ctx, lora_cmd_cb cb, void *context )
+{
+    if( !_lora_claim( ctx, false, cb, context ) )
+        return false;
+
+    _lora_reset_start( ctx );
+
+    return true;
+}
+
+uint8_t lora_reset( lora_ctx_t *ctx )
+{
+    if( !_lora_sync_claim( ctx, false ) )
+        return LORA_ERR_BUSY;
+
+    _lora_reset_start( ctx );
+
+    return _lora_sync_wait( ctx, NULL );
+}
+/******************************************************************************
+*  LoRa BANNER
+*******************************************************************************/
+bool lora_banner( const char *line )
+{
+    for( size_t i = 0; i < sizeof( _banner_table ) / sizeof( _banner_table[ 0 ] ); i++ )
+    {
+        if( !strncmp( line, _banner_table[ i ], strlen( _banner_table[ i ] ) ) )
+            return true;
+    }
+
+    return false;
 }
 /******************************************************************************
 *  LoRa CMD
 *******************************************************************************/
-void lora_cmd(char *cmd,  char *response)
+bool lora_cmd_async( lora_ctx_t *ctx, char *cmd, lora_cmd_cb cb, void *context )
 {
-    while( !_lora_rdy_f )
-        lora_process();
+    lora_cmd_builder_t builder;
+
+    if( !_lora_claim( ctx, false, cb, context ) )
+        return false;
+
+    _lora_cmd_begin( ctx, &builder );
+    _lora_cmd_str( &builder, cmd );
+
+    return _lora_send( ctx, &builder );
+}
 
-    strcpy( _tx_buffer, cmd );
+void lora_cmd( lora_ctx_t *ctx, char *cmd,  char *response)
+{
+    lora_cmd_builder_t builder;
 
-    _rsp_buffer = response;
-    _lora_write();
+    if( !_lora_sync_claim( ctx, false ) )
+        return;
 
-    while( !_lora_rdy_f )
-        lora_process();
+    _lora_cmd_begin( ctx, &builder );
+    _lora_cmd_str( &builder, cmd );
 
-    Log_Debug( "[DEBUG] UART < %s", response);
+    if( _lora_send( ctx, &builder ) )
+        _lora_sync_wait( ctx, response );
 }
 /******************************************************************************
-* LoRa MAC TX
+*  LoRa SCRIPT
 *******************************************************************************/
-uint8_t lora_mac_tx(char* payload, char* port_no, char *buffer, char *response)
+bool lora_script_async( lora_ctx_t *ctx, lora_script_step_t *steps, size_t count, lora_script_cb cb, void *context )
 {
-    uint8_t res   = 0;
+    if( !ctx->rdy_f || ctx->script_steps )
+    {
+        LORA_LOG_DEBUG("[DEBUG] LoRa busy, script rejected\n");
+        return false;
+    }
 
-    while( !_lora_rdy_f )
-        lora_process();
+    for( size_t i = 0; i < count; i++ )
+    {
+        steps[ i ].result       = 0;
+        steps[ i ].response[ 0 ] = '\0';
+    }
+
+    ctx->script_steps   = steps;
+    ctx->script_count   = count;
+    ctx->script_index   = 0;
+    ctx->script_failed  = 0;
+    ctx->script_cancel_f = false;
+    ctx->script_cb      = cb;
+    ctx->script_context = context;
 
-    strcpy( _tx_buffer, ( char* )LORA_MAC_TX );
-    strcat( _tx_buffer, payload);
-    strcat( _tx_buffer, " " );
-    strcat( _tx_buffer, port_no );
-    strcat( _tx_buffer, " " );
-    strcat( _tx_buffer, buffer );
-    _rsp_buffer = response;
-    _lora_write();
+    _lora_script_next( ctx );
 
-    while( !_lora_rdy_f )
-        lora_process();
+    return true;
+}
 
-    if( ( res = _lora_par() ) )
-        return res;
+size_t lora_script( lora_ctx_t *ctx, lora_script_step_t *steps, size_t count )
+{
+    _lora_wait( ctx, &ctx->rdy_f );
+    ctx->sync_done_f = false;
 
-    _lora_resp();
+    if( !lora_script_async( ctx, steps, count, _lora_script_sync_cb, ctx ) )
+        return count;
 
-    do 
+    _lora_wait( ctx, &ctx->sync_done_f );
+
+    return ctx->script_failed;
+}
+/******************************************************************************
+* LoRa MAC TX
+*******************************************************************************/
+static void _lora_mac_tx_build( lora_cmd_builder_t *cmd, char* payload, char* port_no, char *buffer )
+{
+    _lora_cmd_str( cmd, LORA_MAC_TX );
+    _lora_cmd_str( cmd, payload );
+    _lora_cmd_str( cmd, " " );
+    _lora_cmd_str( cmd, port_no );
+    _lora_cmd_str( cmd, " " );
+    _lora_cmd_str( cmd, buffer );
+}
+
+/*
+ * Hex encodes the payload directly behind the command prefix. */
+static void _lora_mac_tx_bytes_build( lora_cmd_builder_t *cmd, uint8_t port, const uint8_t *data,
+                                      size_t len, bool confirmed )
+{
+    _lora_cmd_str( cmd, LORA_MAC_TX );
+    _lora_cmd_str( cmd, confirmed ? "cnf " : "uncnf " );
+    _lora_cmd_dec( cmd, port );
+    _lora_cmd_str( cmd, " " );
+    _lora_cmd_hex( cmd, data, len );
+}
+
+bool lora_mac_tx_bytes_async( lora_ctx_t *ctx, uint8_t port, const uint8_t *data, size_t len, bool confirmed,
+                              lora_cmd_cb cb, void *context )
+{
+    lora_cmd_builder_t builder;
+
+    if( len > LORA_MAX_PAYLOAD_SIZE )
     {
-        while( !_lora_rdy_f )
-            lora_process();
+        LORA_LOG_DEBUG("[DEBUG] payload of %zu bytes rejected\n", len);
+        LORA_CTX_TRACE( ctx, LORA_TRACE_REJECT, 0, len );
+        return false;
+    }
+
+    if( !_lora_claim( ctx, true, cb, context ) )
+        return false;
+
+    _lora_cmd_begin( ctx, &builder );
+    _lora_mac_tx_bytes_build( &builder, port, data, len, confirmed );
+
+    return _lora_send( ctx, &builder );
+}
+
+uint8_t lora_mac_tx_bytes( lora_ctx_t *ctx, uint8_t port, const uint8_t *data, size_t len, bool confirmed )
+{
+    lora_cmd_builder_t builder;
+
+    if( len > LORA_MAX_PAYLOAD_SIZE )
+        return LORA_ERR_INVALID_DATA_LEN;
 
-    } while( ( res = _lora_repar() ) == 12 );
+    if( !_lora_sync_claim( ctx, true ) )
+        return LORA_ERR_BUSY;
 
-    return res;
+    _lora_cmd_begin( ctx, &builder );
+    _lora_mac_tx_bytes_build( &builder, port, data, len, confirmed );
+
+    if( !_lora_send( ctx, &builder ) )
+        return LORA_ERR_INVALID_DATA_LEN;
+
+    return _lora_sync_wait( ctx, NULL );
+}
+
+bool lora_mac_tx_async( lora_ctx_t *ctx, char* payload, char* port_no, char *buffer, lora_cmd_cb cb, void *context )
+{
+    lora_cmd_builder_t builder;
+
+    if( !_lora_claim( ctx, true, cb, context ) )
+        return false;
+
+    _lora_cmd_begin( ctx, &builder );
+    _lora_mac_tx_build( &builder, payload, port_no, buffer );
+
+    return _lora_send( ctx, &builder );
+}
+
+uint8_t lora_mac_tx( lora_ctx_t *ctx, char* payload, char* port_no, char *buffer, char *response)
+{
+    lora_cmd_builder_t builder;
+
+    if( !_lora_sync_claim( ctx, true ) )
+        return LORA_ERR_BUSY;
+
+    _lora_cmd_begin( ctx, &builder );
+    _lora_mac_tx_build( &builder, payload, port_no, buffer );
+
+    if( !_lora_send( ctx, &builder ) )
+        return LORA_ERR_INVALID_DATA_LEN;
+
+    return _lora_sync_wait( ctx, response );
+}
+/******************************************************************************
+* LoRa DOWNLINK CB
+*******************************************************************************/
+void lora_set_downlink_cb( lora_ctx_t *ctx, lora_downlink_cb cb, void *context )
+{
+    ctx->downlink_cb        = cb;
+    ctx->downlink_context   = context;
+}
+
+/*
+ * The module does not report the FPending bit: the network sends queued
+ * downlinks one per uplink, so after a downlink another one may wait for
+ * the next uplink. Cleared by the next uplink that brings nothing back. */
+bool lora_downlink_pending( lora_ctx_t *ctx )
+{
+    return ctx->downlink_pending_f;
+}
+/******************************************************************************
+* LoRa IDLE CB
+*******************************************************************************/
+void lora_set_idle_cb( lora_ctx_t *ctx, lora_idle_cb cb, void *context )
+{
+    ctx->idle_cb        = cb;
+    ctx->idle_context   = context;
+}
+/******************************************************************************
+* LoRa FRAME CB
+*******************************************************************************/
+void lora_set_frame_cb( lora_ctx_t *ctx, lora_frame_cb cb, void *context )
+{
+    ctx->frame_cb       = cb;
+    ctx->frame_context  = context;
+}
+/******************************************************************************
+* LoRa RESULT CB
+*******************************************************************************/
+void lora_set_result_cb( lora_ctx_t *ctx, lora_result_cb cb, void *context )
+{
+    ctx->result_cb      = cb;
+    ctx->result_context = context;
 }
 /******************************************************************************
 *  LoRa JOIN
 *******************************************************************************/
-uint8_t lora_join(char* join_mode, char *response)
+bool lora_join_async( lora_ctx_t *ctx, char* join_mode, lora_cmd_cb cb, void *context )
 {
-    uint8_t res = 0;
+    lora_cmd_builder_t builder;
 
-    while( !_lora_rdy_f )
-        lora_process();
+    if( !_lora_claim( ctx, true, cb, context ) )
+        return false;
 
-    strcpy( _tx_buffer, ( char* )LORA_JOIN );
-    strcat( _tx_buffer, join_mode );
-    _rsp_buffer = response;
-    _lora_write();
+    _lora_cmd_begin( ctx, &builder );
+    _lora_cmd_str( &builder, LORA_JOIN );
+    _lora_cmd_str( &builder, join_mode );
 
-    while( !_lora_rdy_f )
-        lora_process();
+    return _lora_send( ctx, &builder );
+}
+
+uint8_t lora_join( lora_ctx_t *ctx, char* join_mode, char *response)
+{
+    lora_cmd_builder_t builder;
 
-    if( ( res = _lora_par() ) )
-        return res;
+    if( !_lora_sync_claim( ctx, true ) )
+        return LORA_ERR_BUSY;
 
-    _lora_resp();
+    _lora_cmd_begin( ctx, &builder );
+    _lora_cmd_str( &builder, LORA_JOIN );
+    _lora_cmd_str( &builder, join_mode );
 
-    while( !_lora_rdy_f )
-        lora_process();
+    if( !_lora_send( ctx, &builder ) )
+        return LORA_ERR_INVALID_PARAM;
 
-    return _lora_repar();
+    return _lora_sync_wait( ctx, response );
 }
 /******************************************************************************
 * LORA RX
 *******************************************************************************/
-uint8_t lora_rx(char* window_size, char *response)
+bool lora_rx_async( lora_ctx_t *ctx, char* window_size, lora_cmd_cb cb, void *context )
 {
-    uint8_t res = 0;
+    lora_cmd_builder_t builder;
 
-    while( !_lora_rdy_f )
-        lora_process();
+    if( !_lora_claim( ctx, true, cb, context ) )
+        return false;
 
-    strcpy( _tx_buffer, "radio rx " );
-    strcat( _tx_buffer, window_size );
-    _rsp_buffer = response;
-    _lora_write();
+    _lora_cmd_begin( ctx, &builder );
+    _lora_cmd_str( &builder, LORA_RADIO_RX );
+    _lora_cmd_str( &builder, window_size );
 
-   while( !_lora_rdy_f )
-        lora_process();
+    return _lora_send( ctx, &builder );
+}
+
+uint8_t lora_rx( lora_ctx_t *ctx, char* window_size, char *response)
+{
+    lora_cmd_builder_t builder;
 
-    if(res == _lora_par())
-        return res;
+    if( !_lora_sync_claim( ctx, true ) )
+        return LORA_ERR_BUSY;
 
-    _lora_resp();
+    _lora_cmd_begin( ctx, &builder );
+    _lora_cmd_str( &builder, LORA_RADIO_RX );
+    _lora_cmd_str( &builder, window_size );
 
-    while( !_lora_rdy_f )
-        lora_process();
+    if( !_lora_send( ctx, &builder ) )
+        return LORA_ERR_INVALID_PARAM;
 
-    return _lora_repar();
+    return _lora_sync_wait( ctx, response );
 }
 /******************************************************************************
 * LORA TX
 *******************************************************************************/
-uint8_t lora_tx( char *buffer )
+bool lora_tx_async( lora_ctx_t *ctx, char *buffer, lora_cmd_cb cb, void *context )
 {
-    uint8_t res = 0;
-    
-    lora_process();
-    strcpy( _tx_buffer, "radio tx ");
-    strcat( _tx_buffer, buffer );
+    lora_cmd_builder_t builder;
+
+    if( !_lora_claim( ctx, true, cb, context ) )
+        return false;
+
+    _lora_cmd_begin( ctx, &builder );
+    _lora_cmd_str( &builder, LORA_RADIO_TX );
+    _lora_cmd_str( &builder, buffer );
 
-    _lora_write();
+    return _lora_send( ctx, &builder );
+}
+
+uint8_t lora_tx( lora_ctx_t *ctx, char *buffer )
+{
+    lora_cmd_builder_t builder;
 
-    lora_process();
+    if( !_lora_sync_claim( ctx, true ) )
+        return LORA_ERR_BUSY;
 
-    if( ( res = _lora_par() ) )
-        return res;
+    _lora_cmd_begin( ctx, &builder );
+    _lora_cmd_str( &builder, LORA_RADIO_TX );
+    _lora_cmd_str( &builder, buffer );
 
-    _lora_resp();
-    lora_process();
+    if( !_lora_send( ctx, &builder ) )
+        return LORA_ERR_INVALID_DATA_LEN;
 
-    return _lora_repar();
+    return _lora_sync_wait( ctx, NULL );
 }
 /******************************************************************************
 * LORA RX ISR
 *******************************************************************************/
-void lora_rx_isr( char rx_input )
+bool lora_rx_isr( lora_ctx_t *ctx, char rx_input )
 {
-    _rx_buffer[ _rx_buffer_len++ ] = rx_input;
-     if ( rx_input == '\r' )
+    static const uint8_t rx_break = LORA_IO_RX_BREAK;
+
+    /* The ring has a single producer: the I/O thread, while it owns the UART */
+    if( ctx->io_thread_f )
     {
-        _rx_buffer[ _rx_buffer_len++ ] = '\0';
-        _rsp_rdy_f = true;  
-    } 
+        LORA_CTX_TRACE( ctx, LORA_TRACE_REJECT, 0, 1 );
+        return false;
+    }
+
+    /* A byte before was lost: a break goes first, the line is dropped */
+    if( ctx->rx_isr_lost_f && lora_ring_push( &ctx->rx_ring, &rx_break, 1 ) )
+        ctx->rx_isr_lost_f = false;
+
+    if( ctx->rx_isr_lost_f || !lora_ring_push( &ctx->rx_ring, ( uint8_t* )&rx_input, 1 ) )
+        ctx->rx_isr_lost_f = true;
+
+    return true;
 }
 /******************************************************************************
-* LORA TICK ISR
+* LORA RX STATS
 *******************************************************************************/
-void lora_tick_isr()
+void lora_rx_stats( lora_ctx_t *ctx, lora_rx_stats_t *stats )
 {
-    if( _timer_use_f )
-        if( _timer_f && ( _ticker++ > _timer_max ) )
-            _timeout_f = true;
+    stats->ring_overflows   = atomic_load( &ctx->rx_ring.overflows );
+    stats->ring_high_water  = atomic_load( &ctx->rx_ring.high_water );
+    stats->line_overflows   = ctx->rx_line_overflows;
 }
 /******************************************************************************
-* LoRa TICK CONF
+* LORA METRICS
 *******************************************************************************/
-void lora_tick_conf( uint32_t timer_limit )
+void lora_metrics( lora_ctx_t *ctx, lora_metrics_t *metrics )
 {
-    if ( timer_limit )
-    {
-        _timer_max = timer_limit;
-        _timer_use_f = true;
-    } 
-    else 
-    {
-        _timer_max = LORA_TIMER_EXPIRED;
-        _timer_use_f = false;
-    }
+    *metrics                = ctx->metrics;
+    metrics->rx_overflows   = _lora_rx_overflows( ctx ) - ctx->metrics_rx_base;
+    metrics->airtime_ms     = ( uint32_t )( ctx->metrics_airtime_us / 1000u );
+}
+
+void lora_metrics_reset( lora_ctx_t *ctx )
+{
+    memset( &ctx->metrics, 0, sizeof( ctx->metrics ) );
+    ctx->metrics_rx_base        = _lora_rx_overflows( ctx );
+    ctx->metrics_airtime_us     = 0;
+}
+
+/*
+ * The duty-cycle accounting knows what a frame cost, the driver does not:
+ * it charges each frame of the module here. */
+void lora_metrics_airtime( lora_ctx_t *ctx, uint32_t toa_us )
+{
+    ctx->metrics_airtime_us += toa_us;
+}
+/******************************************************************************
+* LoRa TIMEOUT CONF
+*******************************************************************************/
+void lora_timeout_conf( lora_ctx_t *ctx, uint32_t first_ms, uint32_t second_ms )
+{
+    ctx->timeout_first  = first_ms ? first_ms : LORA_TIMEOUT_FIRST;
+    ctx->timeout_second = second_ms ? second_ms : LORA_TIMEOUT_SECOND;
+}
+/******************************************************************************
+* LoRa CANCEL
+*******************************************************************************/
+void lora_cancel( lora_ctx_t *ctx )
+{
+    if( ctx->rdy_f )
+        return;
+
+    LORA_LOG_WARN("[WARN] LoRa command cancelled\n");
+    _lora_abort( ctx, LORA_ERR_CANCELLED );
 }
 /******************************************************************************
 *  LoRa PROCESS
 *******************************************************************************/
-void lora_process()
+void lora_process( lora_ctx_t *ctx )
 {
-    uint8_t tmp;
+    uint8_t *span;
+    size_t room;
+    ssize_t len;
 
-    while (LoRa_hal_uartRead(&tmp) > 0)
+    /* The I/O thread fills the ring, the event only says there is a line */
+    if( ctx->io_thread_f )
+        lora_io_ack( &ctx->io );
+
+    /* Read straight into the ring, then let the parser consume it */
+    while ( !ctx->io_thread_f && ( room = lora_ring_write_span( &ctx->rx_ring, &span ) ) > 0 &&
+            ( len = LoRa_hal_uartReadBuf( &ctx->hal, span, room ) ) > 0 )
     {
-        lora_rx_isr( tmp );
+        lora_ring_commit( &ctx->rx_ring, ( size_t )len );
+        _lora_rx_drain( ctx );
     }
 
-    if ( _rsp_rdy_f )
-    {        
-        _lora_read();
-    }
+    _lora_rx_drain( ctx );
 
-    if ( _timeout_f )
+    if ( !ctx->rdy_f && _lora_deadline_ms( ctx ) == 0 )
     {
-        _lora_read();
+        if( ctx->cmd_phase == LORA_PHASE_RESET )
+        {
+            /* End of the pulse: the module boots and announces itself */
+            LoRa_hal_gpio_rstSet( &ctx->hal, 1 );
+            ctx->cmd_phase = LORA_PHASE_BOOT;
+            _lora_arm( ctx, LORA_TIMEOUT_BOOT );
+        }
+        else if( ctx->cmd_phase == LORA_PHASE_FAILED )
+            _lora_abort( ctx, LORA_ERR_IO );
+        else if( ctx->cmd_phase == LORA_PHASE_BOOT )
+        {
+            LORA_LOG_WARN("[WARN] LoRa boot banner missing, reset timed out\n");
+            _lora_abort( ctx, LORA_ERR_TIMEOUT );
+        }
+        else
+        {
+            LORA_LOG_WARN("[WARN] LoRa response timeout\n");
+            _lora_abort( ctx, LORA_ERR_TIMEOUT );
+        }
     }
-}
\ No newline at end of file
+}
@@ -1,46 +1,418 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <time.h>
+
+#include <applibs/eventloop.h>
+
+#include "eventloop_timer_utilities.h"
+#include "LoRa_Airtime.h"
+#include "LoRa_Hal.h"
+#include "LoRa_Io.h"
+#include "LoRa_Ring.h"
+
+/**
+ * Result Codes */
+#define LORA_OK                     0
+#define LORA_ERR_INVALID_PARAM      1
+#define LORA_ERR_NOT_JOINED         2
+#define LORA_ERR_NO_FREE_CH         3
+#define LORA_ERR_SILENT             4
+#define LORA_ERR_FRAME_COUNTER      5
+#define LORA_ERR_BUSY               6
+#define LORA_ERR_MAC_PAUSED         7
+#define LORA_ERR_INVALID_DATA_LEN   8
+#define LORA_ERR_KEYS_NOT_INIT      9
+#define LORA_ERR_MAC                10
+#define LORA_MAC_RX                 12      /* uplink done, downlink received */
+#define LORA_ERR_RADIO              14
+#define LORA_ERR_DENIED             18
+#define LORA_ERR_TIMEOUT            19      /* no answer before the deadline */
+#define LORA_ERR_CANCELLED          20
+#define LORA_ERR_IO                 21      /* the command could not be written */
+
+/**
+ * @brief Response type, from the first word of a module line
+ */
+typedef enum {
+    LORA_RSP_VALUE = 0,         /* anything else: get answers, banner...  */
+    LORA_RSP_OK,
+    LORA_RSP_INVALID_PARAM,
+    LORA_RSP_NOT_JOINED,
+    LORA_RSP_NO_FREE_CH,
+    LORA_RSP_SILENT,
+    LORA_RSP_FRAME_COUNTER_ERR,
+    LORA_RSP_BUSY,
+    LORA_RSP_MAC_PAUSED,
+    LORA_RSP_INVALID_DATA_LEN,
+    LORA_RSP_KEYS_NOT_INIT,
+    LORA_RSP_MAC_ERR,
+    LORA_RSP_MAC_TX_OK,
+    LORA_RSP_MAC_RX,
+    LORA_RSP_RADIO_ERR,
+    LORA_RSP_RADIO_TX_OK,
+    LORA_RSP_RADIO_RX,
+    LORA_RSP_ACCEPTED,
+    LORA_RSP_DENIED
+} lora_rsp_t;
+
+/**
+ * @brief Classified response line
+ *
+ * line and data point into the driver receive buffer: they are only
+ * valid until the callback that received the view returns. The payload
+ * of a mac_rx handed to the downlink callback is decoded over its hex:
+ * the views given afterwards end the line at the port and have no data.
+ */
+typedef struct {
+    lora_rsp_t   type;
+    const char  *line;          /* whole line, NUL terminated              */
+    uint16_t     line_len;
+    uint8_t      port;          /* FPort of mac_rx                         */
+    const char  *data;          /* hex payload of mac_rx / radio_rx, or NULL */
+    uint16_t     data_len;
+} lora_rsp_view_t;
+
+/**
+ * @brief Command completion callback
+ *
+ * @param[in] result   result code of the final response ( LORA_OK on success )
+ * @param[in] rsp      final response, valid only during the call
+ * @param[in] context  user pointer given at submission
+ */
+typedef void (*lora_cmd_cb)( uint8_t result, const lora_rsp_view_t *rsp, void *context );
+
+/**
+ * @brief Downlink callback, data is the decoded binary payload
+ *
+ * data points into the driver receive buffer and is only valid during
+ * the call. Called ahead of the result and completion callbacks of the
+ * mac tx that brought the downlink.
+ */
+typedef void (*lora_downlink_cb)( uint8_t port, const uint8_t *data, size_t len, void *context );
+
+/**
+ * @brief Idle callback, the engine is free for the next command
+ */
+typedef void (*lora_idle_cb)( void *context );
+
+/**
+ * @brief Frame callback, an uplink went on air
+ *
+ * @param[in] downlink  a downlink was received in its receive windows
+ */
+typedef void (*lora_frame_cb)( bool downlink, void *context );
+
+/**
+ * @brief Result callback, every command that completed
+ *
+ * Called ahead of the completion callback, with the engine already free:
+ * a command submitted from here goes before anything the completion
+ * callback or the idle hook would submit.
+ */
+typedef void (*lora_result_cb)( uint8_t result, const lora_rsp_view_t *rsp, void *context );
+
+/**
+ * Largest Application Payload ( bytes ), EU868 DR4-7: the sizes of the
+ * slower rates are in LoRa_Airtime.h */
+#define LORA_MAX_PAYLOAD_SIZE LORA_AIRTIME_PAYLOAD_DR4_7
+
+/**
+ * Command Buffer Size, fits "mac tx cnf <port> " and the largest payload in hex */
+#define LORA_MAX_TRANSFER_SIZE 512
+
+/**
+ * Response Line Max Size, fits "mac_rx <port> " and the largest downlink */
+#define LORA_MAX_LINE_SIZE 512
+
+/**
+ * Script Step Response Size */
+#define LORA_SCRIPT_RSP_SIZE 32
+
+/**
+ * @brief One command of a script, with its result filled in on completion
+ */
+typedef struct {
+    char    *cmd;
+    uint8_t  result;                            /* result code, LORA_OK on success */
+    char     response[ LORA_SCRIPT_RSP_SIZE ];  /* truncated response line   */
+} lora_script_step_t;
+
+/**
+ * @brief Script completion callback
+ *
+ * @param[in] steps   the submitted steps, results filled in
+ * @param[in] count   number of steps
+ * @param[in] failed  number of steps with a non-zero result
+ * @param[in] context user pointer given at submission
+ */
+typedef void (*lora_script_cb)( lora_script_step_t *steps, size_t count, size_t failed,
+                                void *context );
+
+/**
+ * @brief Receive path counters
+ */
+typedef struct {
+    uint32_t ring_overflows;    /* bytes dropped, receive ring full        */
+    uint32_t ring_high_water;   /* highest receive ring occupancy, bytes   */
+    uint32_t line_overflows;    /* response lines longer than line buffer */
+} lora_rx_stats_t;
+
+/**
+ * Result Codes counted one by one, higher codes share the last bucket */
+#define LORA_METRICS_RESULTS 22
+
+/**
+ * Latency Buckets: bucket 0 holds answers under 1 ms, bucket n those of
+ * 2^( n - 1 ) to 2^n ms, the last one everything slower */
+#define LORA_METRICS_LATENCY_BUCKETS 16
+
+/**
+ * @brief Command kinds, by the first words of the command
+ */
+typedef enum {
+    LORA_KIND_MAC_TX = 0,
+    LORA_KIND_MAC_JOIN,
+    LORA_KIND_MAC_SET,
+    LORA_KIND_MAC_GET,
+    LORA_KIND_MAC,              /* other mac commands: save, pause...      */
+    LORA_KIND_RADIO_TX,
+    LORA_KIND_RADIO_RX,
+    LORA_KIND_RADIO,
+    LORA_KIND_SYS,
+    LORA_KIND_OTHER,
+    LORA_KIND_COUNT
+} lora_cmd_kind_t;
+
+/**
+ * @brief Driver metrics, fixed size, counted since lora_init
+ *
+ * Timeouts and cancellations are the LORA_ERR_TIMEOUT and
+ * LORA_ERR_CANCELLED entries of results.
+ */
+typedef struct {
+    uint32_t commands[ LORA_KIND_COUNT ];       /* commands written        */
+    uint32_t results[ LORA_METRICS_RESULTS ];   /* final result codes      */
+    uint32_t joins_accepted;
+    uint32_t downlinks;
+    uint32_t bytes_out;                         /* to the module           */
+    uint32_t bytes_in;                          /* from the module         */
+    uint32_t bytes_copied;                      /* copied by the driver on the event loop  */
+    uint32_t rx_overflows;                      /* ring and line overflows */
+    uint32_t airtime_ms;                        /* time on air charged to the module      */
+    uint32_t latency[ LORA_KIND_COUNT ][ LORA_METRICS_LATENCY_BUCKETS ];  /* to the final answer */
+} lora_metrics_t;
+
+/**
+ * @brief Module bindings, filled with the defaults by lora_cfg_setup
+ */
+typedef struct {
+    lora_hal_cfg_t  hal;            /* UART and GPIO, or serial device path */
+} lora_cfg_t;
+
+/**
+ * @brief Driver instance, one per module
+ *
+ * Allocated by the caller and set up by lora_init. Instances are
+ * independent: several modules run side by side on one event loop, each
+ * with its own buffers, engine and HAL bindings. The layers above the
+ * driver ( uplink, batch, join, session, downlink, airtime, health, link )
+ * are not: each serves the one instance given to its init. The fields
+ * are private to the driver.
+ */
+typedef struct lora_ctx {
+    lora_hal_t          hal;
+    uint8_t             id;             /* instance number, in trace entries */
+
+    /* Buffers */
+    char                tx_buffer[ LORA_MAX_TRANSFER_SIZE ];
+    char                rx_buffer[ LORA_MAX_LINE_SIZE ];
+    uint16_t            rx_buffer_len;
+    uint16_t            rx_word_len;
+    bool                rx_discard_f;
+    bool                rx_isr_lost_f;          /* lora_rx_isr dropped a byte */
+    uint32_t            rx_line_overflows;
+
+    /* UART reader -> line parser */
+    lora_ring_t         rx_ring;
+
+    /* Event loop -> I/O thread, commands to write, when the thread owns the UART */
+    lora_ring_t         tx_ring;
+    lora_io_t           io;
+    bool                io_thread_f;
+
+    /* Response deadline, CLOCK_MONOTONIC */
+    struct timespec     cmd_deadline;
+    uint32_t            timeout_first;
+    uint32_t            timeout_second;
+    EventLoopTimer*     cmd_timer;
+
+    /* Command engine */
+    bool                rdy_f;
+    uint8_t             cmd_phase;
+    bool                cmd_two_phase;
+    lora_cmd_cb         cmd_cb;
+    void*               cmd_context;
+
+    /* Downlink, idle, uplink frame and result notifications */
+    lora_downlink_cb    downlink_cb;
+    void*               downlink_context;
+    bool                downlink_pending_f;
+    lora_idle_cb        idle_cb;
+    void*               idle_context;
+    lora_frame_cb       frame_cb;
+    void*               frame_context;
+    lora_result_cb      result_cb;
+    void*               result_context;
+
+    /* Command script */
+    bool                script_cancel_f;
+    bool                script_wait_f;      /* next step waits for the engine */
+    lora_script_step_t* script_steps;
+    size_t              script_count;
+    size_t              script_index;
+    size_t              script_failed;
+    lora_script_cb      script_cb;
+    void*               script_context;
+
+    /* Blocking call completion */
+    bool                sync_done_f;
+    uint8_t             sync_res;
+
+    /* Metrics, rx overflows are counted from the base on */
+    lora_metrics_t      metrics;
+    lora_cmd_kind_t     cmd_kind;
+    struct timespec     cmd_start;
+    uint32_t            metrics_rx_base;
+    uint64_t            metrics_airtime_us;
+
+    /* Event loop registration */
+    EventLoop*          event_loop;
+    EventRegistration*  uart_reg;
+
+    /* Response vars */
+    lora_rsp_view_t     rsp;
+    char*               rsp_buffer;
+} lora_ctx_t;
 
 /* ----------------------------------------------------------- IMPLEMENTATION */
 /******************************************************************************
+*  LoRa CFG SETUP
+*******************************************************************************/
+void lora_cfg_setup( lora_cfg_t *cfg );
+/******************************************************************************
 *  LoRa INIT
 *******************************************************************************/
-void lora_init(void);
+void lora_init( lora_ctx_t *ctx, const lora_cfg_t *cfg );
+/******************************************************************************
+*  LoRa ATTACH
+*******************************************************************************/
+bool lora_attach( lora_ctx_t *ctx, EventLoop *event_loop );
+bool lora_attach_thread( lora_ctx_t *ctx, EventLoop *event_loop );
+/******************************************************************************
+*  LoRa DETACH
+*******************************************************************************/
+void lora_detach( lora_ctx_t *ctx );
+/******************************************************************************
+*  LoRa BUSY
+*******************************************************************************/
+bool lora_busy( lora_ctx_t *ctx );
+/******************************************************************************
+*  LoRa RESET
+*
+*  Pulses the reset line and waits for the boot banner ( RN2483 x.y.z ),
+*  without blocking the event loop. The engine rejects commands until then:
+*  start the first ones from the completion callback. The result is
+*  LORA_OK on the banner, LORA_ERR_TIMEOUT when none came in time; the
+*  engine takes commands again either way.
+*******************************************************************************/
+uint8_t lora_reset( lora_ctx_t *ctx );
+bool lora_reset_async( lora_ctx_t *ctx, lora_cmd_cb cb, void *context );
+/******************************************************************************
+*  LoRa BANNER
+*
+*  True for the line a module prints when it boots, or answers to
+*  "sys get ver": RN2483 or RN2903, then its version.
+*******************************************************************************/
+bool lora_banner( const char *line );
 /******************************************************************************
 *  LoRa CMD
 *******************************************************************************/
-void lora_cmd(char *cmd,  char *response);
+void lora_cmd( lora_ctx_t *ctx, char *cmd,  char *response );
+bool lora_cmd_async( lora_ctx_t *ctx, char *cmd, lora_cmd_cb cb, void *context );
+/******************************************************************************
+*  LoRa SCRIPT
+*******************************************************************************/
+size_t lora_script( lora_ctx_t *ctx, lora_script_step_t *steps, size_t count );
+bool lora_script_async( lora_ctx_t *ctx, lora_script_step_t *steps, size_t count, lora_script_cb cb, void *context );
 /******************************************************************************
 * LoRa MAC TX
 *******************************************************************************/
-uint8_t lora_mac_tx(char* payload, char* port_no, char *buffer, char *response);
+uint8_t lora_mac_tx( lora_ctx_t *ctx, char* payload, char* port_no, char *buffer, char *response );
+bool lora_mac_tx_async( lora_ctx_t *ctx, char* payload, char* port_no, char *buffer, lora_cmd_cb cb, void *context );
+uint8_t lora_mac_tx_bytes( lora_ctx_t *ctx, uint8_t port, const uint8_t *data, size_t len, bool confirmed );
+bool lora_mac_tx_bytes_async( lora_ctx_t *ctx, uint8_t port, const uint8_t *data, size_t len, bool confirmed,
+                              lora_cmd_cb cb, void *context );
+/******************************************************************************
+* LoRa DOWNLINK CB
+*******************************************************************************/
+void lora_set_downlink_cb( lora_ctx_t *ctx, lora_downlink_cb cb, void *context );
+bool lora_downlink_pending( lora_ctx_t *ctx );
+/******************************************************************************
+* LoRa IDLE CB
+*******************************************************************************/
+void lora_set_idle_cb( lora_ctx_t *ctx, lora_idle_cb cb, void *context );
+/******************************************************************************
+* LoRa FRAME CB
+*******************************************************************************/
+void lora_set_frame_cb( lora_ctx_t *ctx, lora_frame_cb cb, void *context );
+/******************************************************************************
+* LoRa RESULT CB
+*******************************************************************************/
+void lora_set_result_cb( lora_ctx_t *ctx, lora_result_cb cb, void *context );
 /******************************************************************************
 *  LoRa JOIN
 *******************************************************************************/
-uint8_t lora_join(char* join_mode, char *response);
+uint8_t lora_join( lora_ctx_t *ctx, char* join_mode, char *response );
+bool lora_join_async( lora_ctx_t *ctx, char* join_mode, lora_cmd_cb cb, void *context );
 /******************************************************************************
 * LORA RX
 *******************************************************************************/
-uint8_t lora_rx(char* window_size, char *response);
+uint8_t lora_rx( lora_ctx_t *ctx, char* window_size, char *response );
+bool lora_rx_async( lora_ctx_t *ctx, char* window_size, lora_cmd_cb cb, void *context );
 /******************************************************************************
 * LORA TX
 *******************************************************************************/
-uint8_t lora_tx( char *buffer );
+uint8_t lora_tx( lora_ctx_t *ctx, char *buffer );
+bool lora_tx_async( lora_ctx_t *ctx, char *buffer, lora_cmd_cb cb, void *context );
 /******************************************************************************
 * LORA RX ISR
+*
+* Feeds one received byte to the driver. Refused, returning false, after
+* lora_attach_thread: the I/O thread then reads the UART itself.
+*******************************************************************************/
+bool lora_rx_isr( lora_ctx_t *ctx, char rx_input );
+/******************************************************************************
+* LORA RX STATS
+*******************************************************************************/
+void lora_rx_stats( lora_ctx_t *ctx, lora_rx_stats_t *stats );
+/******************************************************************************
+* LORA METRICS
 *******************************************************************************/
-void lora_rx_isr( char rx_input );
+void lora_metrics( lora_ctx_t *ctx, lora_metrics_t *metrics );
+void lora_metrics_reset( lora_ctx_t *ctx );
+void lora_metrics_airtime( lora_ctx_t *ctx, uint32_t toa_us );
 /******************************************************************************
-* LORA TICK ISR
+* LoRa TIMEOUT CONF
 *******************************************************************************/
-void lora_tick_isr(void);
+void lora_timeout_conf( lora_ctx_t *ctx, uint32_t first_ms, uint32_t second_ms );
 /******************************************************************************
-* LoRa TICK CONF
+* LoRa CANCEL
 *******************************************************************************/
-void lora_tick_conf( uint32_t timer_limit );
+void lora_cancel( lora_ctx_t *ctx );
 /******************************************************************************
 *  LoRa PROCESS
 *******************************************************************************/
-void lora_process(void);
\ No newline at end of file
+void lora_process( lora_ctx_t *ctx );
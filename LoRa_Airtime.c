@@ -0,0 +1,244 @@
+#include "LoRa_Airtime.h"
+
+#include <time.h>
+
+#include "LoRa_Log.h"
+
+/**
+ * LoRa Modulation Parameters of the module ( mac layer ) */
+#define LORA_AIRTIME_PREAMBLE   8
+#define LORA_AIRTIME_CR         1       /* 4/5 */
+
+/**
+ * FSK Frame Overhead ( bytes ): preamble, sync word, length, CRC */
+#define LORA_AIRTIME_FSK_OVERHEAD 11
+
+/**
+ * Default Data Rate, module default after mac reset 868 */
+#define LORA_AIRTIME_DEFAULT_DR 5
+
+/**
+ * @brief EU868 data rate
+ */
+typedef struct {
+    uint8_t     sf;             /* 0 for FSK                               */
+    uint32_t    bw_hz;
+    uint8_t     max_payload;    /* N, application payload without FOpts    */
+} lora_airtime_dr_t;
+
+static const lora_airtime_dr_t _dr_table[] = {
+    { 12, 125000, LORA_AIRTIME_PAYLOAD_DR0_2 }, { 11, 125000, LORA_AIRTIME_PAYLOAD_DR0_2 },
+    { 10, 125000, LORA_AIRTIME_PAYLOAD_DR0_2 }, {  9, 125000, LORA_AIRTIME_PAYLOAD_DR3   },
+    {  8, 125000, LORA_AIRTIME_PAYLOAD_DR4_7 }, {  7, 125000, LORA_AIRTIME_PAYLOAD_DR4_7 },
+    {  7, 250000, LORA_AIRTIME_PAYLOAD_DR4_7 }, {  0,  50000, LORA_AIRTIME_PAYLOAD_DR4_7 },    /* DR7: FSK 50 kbps */
+};
+
+#define LORA_AIRTIME_DR_COUNT ( sizeof( _dr_table ) / sizeof( _dr_table[ 0 ] ) )
+
+/**
+ * @brief Sub-band limits and duty cycle ( per mille )
+ */
+typedef struct {
+    uint32_t    low_hz;
+    uint32_t    high_hz;
+    uint16_t    duty_permille;
+} lora_airtime_band_t;
+
+static const lora_airtime_band_t _bands[ LORA_SUBBAND_COUNT ] = {
+    [ LORA_SUBBAND_G  ] = { 865000000, 868000000,  10 },
+    [ LORA_SUBBAND_G1 ] = { 868000000, 868600000,  10 },
+    [ LORA_SUBBAND_G2 ] = { 868700000, 869200000,   1 },
+    [ LORA_SUBBAND_G3 ] = { 869400000, 869650000, 100 },
+    [ LORA_SUBBAND_G4 ] = { 869700000, 870000000,  10 },
+};
+
+/* Channel plan, mirrors the module's */
+static uint32_t     _ch_freq[ LORA_AIRTIME_CHANNELS ];
+static bool         _ch_enabled[ LORA_AIRTIME_CHANNELS ];
+static uint8_t      _dr;
+
+/* Earliest transmission per sub-band, CLOCK_MONOTONIC ms */
+static uint64_t     _band_ready_ms[ LORA_SUBBAND_COUNT ];
+
+/* Time on air charged since init */
+static uint64_t     _used_us;
+
+static uint64_t _airtime_now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( uint64_t )now.tv_sec * 1000u + ( uint64_t )now.tv_nsec / 1000000u;
+}
+
+/*
+ * Sub-band the module can transmit in first, and how long until then.
+ * The module picks a random free channel, so the earliest band is the one
+ * it will use. */
+static lora_subband_t _airtime_next_band( uint64_t now, uint64_t *wait )
+{
+    lora_subband_t next = LORA_SUBBAND_NONE;
+
+    *wait = 0;
+
+    for( uint8_t ch = 0; ch < LORA_AIRTIME_CHANNELS; ch++ )
+    {
+        lora_subband_t band;
+        uint64_t band_wait;
+
+        if( !_ch_enabled[ ch ] || ( band = lora_airtime_subband( _ch_freq[ ch ] ) ) == LORA_SUBBAND_NONE )
+            continue;
+
+        band_wait = _band_ready_ms[ band ] > now ? _band_ready_ms[ band ] - now : 0;
+
+        if( next == LORA_SUBBAND_NONE || band_wait < *wait )
+        {
+            next  = band;
+            *wait = band_wait;
+        }
+    }
+
+    return next;
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa AIRTIME
+*******************************************************************************/
+uint32_t lora_airtime_us( uint8_t sf, uint32_t bw_hz, uint8_t cr, size_t phy_len )
+{
+    /* Explicit header and CRC on, low data rate optimization at SF11/12 125 kHz */
+    uint32_t t_sym = ( ( uint32_t )1 << sf ) * 1000000u / bw_hz;
+    int32_t de = ( sf >= 11 && bw_hz == 125000 ) ? 1 : 0;
+    int32_t num = 8 * ( int32_t )phy_len - 4 * sf + 28 + 16;
+    int32_t den = 4 * ( sf - 2 * de );
+    uint32_t n_payload = 8;
+
+    if( num > 0 )
+        n_payload += ( uint32_t )( ( num + den - 1 ) / den ) * ( cr + 4u );
+
+    /* Preamble lasts n + 4.25 symbols */
+    return ( ( 4u * LORA_AIRTIME_PREAMBLE + 17u ) * t_sym ) / 4u + n_payload * t_sym;
+}
+
+uint32_t lora_airtime_dr_us( uint8_t dr, size_t phy_len )
+{
+    const lora_airtime_dr_t *rate;
+
+    if( dr >= LORA_AIRTIME_DR_COUNT )
+        dr = 0;
+
+    rate = &_dr_table[ dr ];
+
+    /* FSK: 8 bits per byte at the bit rate */
+    if( !rate->sf )
+        return ( uint32_t )( ( phy_len + LORA_AIRTIME_FSK_OVERHEAD ) * 8u * 1000000u / rate->bw_hz );
+
+    return lora_airtime_us( rate->sf, rate->bw_hz, LORA_AIRTIME_CR, phy_len );
+}
+
+size_t lora_airtime_max_payload( uint8_t dr )
+{
+    return _dr_table[ dr < LORA_AIRTIME_DR_COUNT ? dr : 0 ].max_payload;
+}
+/******************************************************************************
+*  LoRa AIRTIME INIT
+*******************************************************************************/
+void lora_airtime_init()
+{
+    for( uint8_t ch = 0; ch < LORA_AIRTIME_CHANNELS; ch++ )
+    {
+        _ch_freq[ ch ]      = 0;
+        _ch_enabled[ ch ]   = false;
+    }
+
+    /* Default join channels */
+    lora_airtime_set_channel( 0, 868100000, true );
+    lora_airtime_set_channel( 1, 868300000, true );
+    lora_airtime_set_channel( 2, 868500000, true );
+
+    for( int band = 0; band < LORA_SUBBAND_COUNT; band++ )
+        _band_ready_ms[ band ] = 0;
+
+    _dr         = LORA_AIRTIME_DEFAULT_DR;
+    _used_us    = 0;
+}
+/******************************************************************************
+*  LoRa AIRTIME CHANNELS
+*******************************************************************************/
+void lora_airtime_set_channel( uint8_t ch, uint32_t freq_hz, bool enabled )
+{
+    if( ch >= LORA_AIRTIME_CHANNELS )
+        return;
+
+    _ch_freq[ ch ]      = freq_hz;
+    _ch_enabled[ ch ]   = enabled;
+}
+
+lora_subband_t lora_airtime_subband( uint32_t freq_hz )
+{
+    /* From the top, so the shared 868.0 MHz edge belongs to g1 */
+    for( int band = LORA_SUBBAND_COUNT - 1; band >= 0; band-- )
+    {
+        if( freq_hz >= _bands[ band ].low_hz && freq_hz <= _bands[ band ].high_hz )
+            return ( lora_subband_t )band;
+    }
+
+    return LORA_SUBBAND_NONE;
+}
+/******************************************************************************
+*  LoRa AIRTIME DATA RATE
+*******************************************************************************/
+void lora_airtime_set_dr( uint8_t dr )
+{
+    _dr = dr;
+}
+
+uint8_t lora_airtime_dr()
+{
+    return _dr;
+}
+/******************************************************************************
+*  LoRa AIRTIME SCHEDULE
+*******************************************************************************/
+uint32_t lora_airtime_wait_ms()
+{
+    uint64_t wait;
+
+    /* No known channel: leave the decision to the module */
+    if( _airtime_next_band( _airtime_now_ms(), &wait ) == LORA_SUBBAND_NONE )
+        return 0;
+
+    return wait > UINT32_MAX ? UINT32_MAX : ( uint32_t )wait;
+}
+
+/*
+ * Returns the time on air charged, in us. */
+uint32_t lora_airtime_charge( size_t phy_len )
+{
+    uint64_t now = _airtime_now_ms();
+    uint64_t wait;
+    lora_subband_t band = _airtime_next_band( now, &wait );
+    uint64_t toa_us = lora_airtime_dr_us( _dr, phy_len );
+    uint64_t off_us;
+
+    _used_us += toa_us;
+
+    if( band == LORA_SUBBAND_NONE )
+        return ( uint32_t )toa_us;
+
+    /* The band stays silent for toa * ( 1 / duty - 1 ) after the frame */
+    off_us = toa_us * ( 1000u / _bands[ band ].duty_permille - 1u );
+
+    _band_ready_ms[ band ] = now + wait + ( off_us + 999u ) / 1000u;
+
+    LORA_LOG_DEBUG("[DEBUG] airtime %u us on sub-band %d, next uplink in %u ms\n",
+                   ( unsigned )toa_us, band, ( unsigned )( _band_ready_ms[ band ] - now ));
+
+    return ( uint32_t )toa_us;
+}
+
+uint32_t lora_airtime_used_ms()
+{
+    return ( uint32_t )( _used_us / 1000u );
+}
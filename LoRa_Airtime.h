@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Largest Application Payload ( bytes ) per EU868 data rate, FOpts excluded */
+#define LORA_AIRTIME_PAYLOAD_DR0_2  51
+#define LORA_AIRTIME_PAYLOAD_DR3    115
+#define LORA_AIRTIME_PAYLOAD_DR4_7  222
+
+/**
+ * LoRaWAN Overhead ( bytes ): MHDR, FHDR without options, FPort, MIC */
+#define LORA_AIRTIME_FRAME_OVERHEAD 13
+
+/**
+ * Join Request Size ( bytes ) */
+#define LORA_AIRTIME_JOIN_REQUEST_SIZE 23
+
+/**
+ * Channels of the module */
+#define LORA_AIRTIME_CHANNELS 16
+
+/**
+ * @brief EU868 sub-bands ( ETSI EN 300 220 ), each with its own duty-cycle budget
+ */
+typedef enum {
+    LORA_SUBBAND_G = 0,     /* 865.0 - 868.0 MHz, 1 %   */
+    LORA_SUBBAND_G1,        /* 868.0 - 868.6 MHz, 1 %   */
+    LORA_SUBBAND_G2,        /* 868.7 - 869.2 MHz, 0.1 % */
+    LORA_SUBBAND_G3,        /* 869.4 - 869.65 MHz, 10 % */
+    LORA_SUBBAND_G4,        /* 869.7 - 870.0 MHz, 1 %   */
+    LORA_SUBBAND_COUNT,
+    LORA_SUBBAND_NONE = LORA_SUBBAND_COUNT
+} lora_subband_t;
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa AIRTIME
+*******************************************************************************/
+uint32_t lora_airtime_us( uint8_t sf, uint32_t bw_hz, uint8_t cr, size_t phy_len );
+uint32_t lora_airtime_dr_us( uint8_t dr, size_t phy_len );
+size_t lora_airtime_max_payload( uint8_t dr );
+/******************************************************************************
+*  LoRa AIRTIME INIT
+*******************************************************************************/
+void lora_airtime_init(void);
+/******************************************************************************
+*  LoRa AIRTIME CHANNELS
+*******************************************************************************/
+void lora_airtime_set_channel( uint8_t ch, uint32_t freq_hz, bool enabled );
+lora_subband_t lora_airtime_subband( uint32_t freq_hz );
+/******************************************************************************
+*  LoRa AIRTIME DATA RATE
+*******************************************************************************/
+void lora_airtime_set_dr( uint8_t dr );
+uint8_t lora_airtime_dr(void);
+/******************************************************************************
+*  LoRa AIRTIME SCHEDULE
+*******************************************************************************/
+uint32_t lora_airtime_wait_ms(void);
+uint32_t lora_airtime_charge( size_t phy_len );
+uint32_t lora_airtime_used_ms(void);
@@ -0,0 +1,146 @@
+#include "LoRa_Batch.h"
+
+#include <string.h>
+
+#include "eventloop_timer_utilities.h"
+#include "LoRa_Airtime.h"
+#include "LoRa_Log.h"
+#include "LoRa_Uplink.h"
+
+/*
+ * Records are concatenated as given: they must be self-delimiting ( fixed
+ * size, or typed like the LPP encoder output ) for the receiver to split
+ * the frame. */
+static uint8_t              _frame[ LORA_MAX_PAYLOAD_SIZE ];
+static size_t               _frame_len;
+
+static uint8_t              _port;
+static uint8_t              _flags;
+static uint32_t             _deadline_ms;
+static EventLoopTimer*      _deadline_timer;
+
+static lora_batch_stats_t   _stats;
+
+static void _batch_arm( uint32_t delay_ms )
+{
+    struct timespec delay = { .tv_sec = delay_ms / 1000, .tv_nsec = ( delay_ms % 1000 ) * 1000000 };
+
+    SetEventLoopTimerOneShot( _deadline_timer, &delay );
+}
+
+static void _batch_submit( lora_uplink_prio_t prio )
+{
+    if( !_frame_len )
+        return;
+
+    DisarmEventLoopTimer( _deadline_timer );
+
+    if( lora_uplink_submit( _port, _frame, _frame_len, prio, _flags ) )
+        _stats.frames++;
+    else
+        LORA_LOG_WARN("[WARN] batch of %zu bytes lost, not queued\n", _frame_len);
+
+    _frame_len = 0;
+}
+
+/*
+ * Deadline of the oldest record. While the duty cycle holds the radio
+ * anyway, the frame keeps filling until the band frees up. */
+static void _batch_deadline_event( EventLoopTimer *timer )
+{
+    uint32_t wait;
+
+    ConsumeEventLoopTimerEvent( timer );
+
+    if( ( wait = lora_airtime_wait_ms() ) > 0 )
+    {
+        _batch_arm( wait );
+        return;
+    }
+
+    _stats.flush_deadline++;
+    _batch_submit( LORA_UPLINK_PRIO_TELEMETRY );
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa BATCH INIT
+*******************************************************************************/
+bool lora_batch_init( EventLoop *event_loop, uint8_t port, uint32_t deadline_ms, uint8_t flags )
+{
+    memset( &_stats, 0, sizeof( _stats ) );
+
+    _frame_len      = 0;
+    _port           = port;
+    _flags          = flags & ~LORA_UPLINK_COALESCE;
+    _deadline_ms    = deadline_ms ? deadline_ms : LORA_BATCH_DEADLINE_MS;
+
+    _deadline_timer = CreateEventLoopDisarmedTimer( event_loop, _batch_deadline_event );
+
+    return _deadline_timer != NULL;
+}
+/******************************************************************************
+*  LoRa BATCH DEINIT
+*******************************************************************************/
+void lora_batch_deinit()
+{
+    DisposeEventLoopTimer( _deadline_timer );
+    _deadline_timer = NULL;
+}
+/******************************************************************************
+*  LoRa BATCH ADD
+*******************************************************************************/
+bool lora_batch_add( const uint8_t *record, size_t len, bool urgent )
+{
+    size_t max = lora_airtime_max_payload( lora_airtime_dr() );
+
+    if( !len || len > max )
+    {
+        LORA_LOG_DEBUG("[DEBUG] record of %zu bytes rejected\n", len);
+        return false;
+    }
+
+    /* The frame is full for the current data rate */
+    if( _frame_len + len > max )
+    {
+        _stats.flush_full++;
+        _batch_submit( LORA_UPLINK_PRIO_TELEMETRY );
+    }
+
+    if( !_frame_len )
+        _batch_arm( _deadline_ms );
+
+    memcpy( _frame + _frame_len, record, len );
+    _frame_len += len;
+    _stats.records++;
+
+    /* Urgent records leave at once, with whatever was waiting */
+    if( urgent )
+    {
+        _stats.flush_urgent++;
+        _batch_submit( LORA_UPLINK_PRIO_ALARM );
+    }
+
+    return true;
+}
+/******************************************************************************
+*  LoRa BATCH FLUSH
+*******************************************************************************/
+void lora_batch_flush()
+{
+    _batch_submit( LORA_UPLINK_PRIO_TELEMETRY );
+}
+/******************************************************************************
+*  LoRa BATCH PENDING
+*******************************************************************************/
+size_t lora_batch_pending()
+{
+    return _frame_len;
+}
+/******************************************************************************
+*  LoRa BATCH STATS
+*******************************************************************************/
+void lora_batch_stats( lora_batch_stats_t *stats )
+{
+    *stats = _stats;
+}
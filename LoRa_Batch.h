@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+#include "LoRa.h"
+
+/**
+ * Default Latency Deadline ( ms ) of the oldest batched record */
+#define LORA_BATCH_DEADLINE_MS 300000
+
+/**
+ * @brief Batching counters
+ */
+typedef struct {
+    uint32_t records;           /* records accepted                        */
+    uint32_t frames;            /* uplinks submitted                       */
+    uint32_t flush_full;        /* the next record did not fit the frame   */
+    uint32_t flush_deadline;    /* the oldest record reached its deadline  */
+    uint32_t flush_urgent;      /* an urgent record was added              */
+} lora_batch_stats_t;
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa BATCH INIT
+*******************************************************************************/
+bool lora_batch_init( EventLoop *event_loop, uint8_t port, uint32_t deadline_ms, uint8_t flags );
+/******************************************************************************
+*  LoRa BATCH DEINIT
+*******************************************************************************/
+void lora_batch_deinit(void);
+/******************************************************************************
+*  LoRa BATCH ADD
+*******************************************************************************/
+bool lora_batch_add( const uint8_t *record, size_t len, bool urgent );
+/******************************************************************************
+*  LoRa BATCH FLUSH
+*******************************************************************************/
+void lora_batch_flush(void);
+/******************************************************************************
+*  LoRa BATCH PENDING
+*
+*  Bytes of the frame being filled, sized for the data rate of its records.
+*******************************************************************************/
+size_t lora_batch_pending(void);
+/******************************************************************************
+*  LoRa BATCH STATS
+*******************************************************************************/
+void lora_batch_stats( lora_batch_stats_t *stats );
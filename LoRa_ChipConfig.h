@@ -2,6 +2,13 @@
 
 #include <hw/avnet_mt3620_sk.h>
 
+/* Click socket 1, the default module */
 #define LORA_UART_RXTX  AVNET_MT3620_SK_ISU0_UART
 #define LORA_UART_RST   AVNET_MT3620_SK_GPIO16
 #define LORA_UART_CS    AVNET_MT3620_SK_GPIO34
+
+/* Click socket 2, for a second module: bind it through lora_cfg_t and add
+   ISU1 and the two GPIOs to app_manifest.json */
+#define LORA_UART2_RXTX AVNET_MT3620_SK_ISU1_UART
+#define LORA_UART2_RST  AVNET_MT3620_SK_GPIO17
+#define LORA_UART2_CS   AVNET_MT3620_SK_GPIO35
@@ -0,0 +1,113 @@
+#include "LoRa_Downlink.h"
+
+#include <string.h>
+
+#include "LoRa_Log.h"
+
+typedef struct {
+    uint8_t             port;           /* 0: free */
+    lora_downlink_cb    cb;
+    void*               context;
+} lora_downlink_handler_t;
+
+static lora_ctx_t*              _lora;
+static lora_downlink_handler_t  _handlers[ LORA_DOWNLINK_HANDLERS ];
+static lora_downlink_handler_t  _default;
+static lora_downlink_stats_t    _stats;
+
+static lora_downlink_handler_t *_downlink_find( uint8_t port )
+{
+    for( size_t i = 0; i < LORA_DOWNLINK_HANDLERS; i++ )
+    {
+        if( _handlers[ i ].port == port )
+            return &_handlers[ i ];
+    }
+
+    return NULL;
+}
+
+/*
+ * data is the payload decoded in place in the driver receive buffer, it
+ * is handed on as is. */
+static void _downlink_dispatch( uint8_t port, const uint8_t *data, size_t len, void *context )
+{
+    lora_downlink_handler_t *handler = port ? _downlink_find( port ) : NULL;
+
+    _stats.received++;
+
+    if( handler )
+    {
+        _stats.dispatched++;
+        handler->cb( port, data, len, handler->context );
+        return;
+    }
+
+    _stats.unhandled++;
+
+    if( _default.cb )
+        _default.cb( port, data, len, _default.context );
+    else
+        LORA_LOG_WARN("[WARN] downlink on port %u dropped, no handler\n", port);
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa DOWNLINK INIT
+*******************************************************************************/
+void lora_downlink_init( lora_ctx_t *lora )
+{
+    _lora = lora;
+
+    memset( _handlers, 0, sizeof( _handlers ) );
+    memset( &_default, 0, sizeof( _default ) );
+    memset( &_stats, 0, sizeof( _stats ) );
+
+    lora_set_downlink_cb( _lora, _downlink_dispatch, NULL );
+}
+/******************************************************************************
+*  LoRa DOWNLINK DEINIT
+*******************************************************************************/
+void lora_downlink_deinit()
+{
+    lora_set_downlink_cb( _lora, NULL, NULL );
+}
+/******************************************************************************
+*  LoRa DOWNLINK REGISTER
+*******************************************************************************/
+bool lora_downlink_register( uint8_t port, lora_downlink_cb cb, void *context )
+{
+    lora_downlink_handler_t *handler;
+
+    if( port < LORA_DOWNLINK_PORT_MIN || port > LORA_DOWNLINK_PORT_MAX || !cb )
+        return false;
+
+    /* Registering a port again replaces its handler */
+    if( !( handler = _downlink_find( port ) ) && !( handler = _downlink_find( 0 ) ) )
+        return false;
+
+    handler->port       = port;
+    handler->cb         = cb;
+    handler->context    = context;
+    return true;
+}
+
+void lora_downlink_unregister( uint8_t port )
+{
+    lora_downlink_handler_t *handler = port ? _downlink_find( port ) : NULL;
+
+    if( handler )
+        memset( handler, 0, sizeof( *handler ) );
+}
+
+void lora_downlink_set_default( lora_downlink_cb cb, void *context )
+{
+    _default.cb         = cb;
+    _default.context    = context;
+}
+/******************************************************************************
+*  LoRa DOWNLINK STATS
+*******************************************************************************/
+void lora_downlink_stats( lora_downlink_stats_t *stats )
+{
+    *stats = _stats;
+}
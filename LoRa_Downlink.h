@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LoRa.h"
+
+/**
+ * Handler Table Size: ports with a handler of their own */
+#define LORA_DOWNLINK_HANDLERS 8
+
+/**
+ * Application FPorts ( 0 carries MAC commands only, 224 and up are reserved ) */
+#define LORA_DOWNLINK_PORT_MIN 1
+#define LORA_DOWNLINK_PORT_MAX 223
+
+/**
+ * @brief Downlink counters
+ */
+typedef struct {
+    uint32_t received;          /* downlinks delivered by the driver       */
+    uint32_t dispatched;        /* handled by the handler of their port    */
+    uint32_t unhandled;         /* no handler: default handler, or dropped */
+} lora_downlink_stats_t;
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa DOWNLINK INIT
+*******************************************************************************/
+void lora_downlink_init( lora_ctx_t *lora );
+/******************************************************************************
+*  LoRa DOWNLINK DEINIT
+*******************************************************************************/
+void lora_downlink_deinit(void);
+/******************************************************************************
+*  LoRa DOWNLINK REGISTER
+*******************************************************************************/
+bool lora_downlink_register( uint8_t port, lora_downlink_cb cb, void *context );
+void lora_downlink_unregister( uint8_t port );
+void lora_downlink_set_default( lora_downlink_cb cb, void *context );
+/******************************************************************************
+*  LoRa DOWNLINK STATS
+*******************************************************************************/
+void lora_downlink_stats( lora_downlink_stats_t *stats );
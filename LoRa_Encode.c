@@ -0,0 +1,229 @@
+#include "LoRa_Encode.h"
+
+#include <math.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t     type;
+    double      resolution;
+    const char  *name;
+} lora_enc_type_info_t;
+
+static const lora_enc_type_info_t _types[] = {
+    { LORA_ENC_DIGITAL_IN,  1.0,  "digital_in"  },
+    { LORA_ENC_DIGITAL_OUT, 1.0,  "digital_out" },
+    { LORA_ENC_ANALOG_IN,   0.01, "analog_in"   },
+    { LORA_ENC_ANALOG_OUT,  0.01, "analog_out"  },
+    { LORA_ENC_ILLUMINANCE, 1.0,  "illuminance" },
+    { LORA_ENC_PRESENCE,    1.0,  "presence"    },
+    { LORA_ENC_TEMPERATURE, 0.1,  "temperature" },
+    { LORA_ENC_HUMIDITY,    0.5,  "humidity"    },
+    { LORA_ENC_BAROMETER,   0.1,  "barometer"   },
+};
+
+static const lora_enc_type_info_t *_enc_type( uint8_t type )
+{
+    for( size_t i = 0; i < sizeof( _types ) / sizeof( _types[ 0 ] ); i++ )
+    {
+        if( _types[ i ].type == type )
+            return &_types[ i ];
+    }
+
+    return NULL;
+}
+
+/*
+ * Zigzag: small magnitudes of either sign map to small unsigned values. */
+static uint32_t _enc_zigzag( int32_t value )
+{
+    return ( ( uint32_t )value << 1 ) ^ ( uint32_t )( value >> 31 );
+}
+
+static int32_t _enc_unzigzag( uint32_t value )
+{
+    return ( int32_t )( value >> 1 ) ^ -( int32_t )( value & 1 );
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa ENC TYPES
+*******************************************************************************/
+double lora_enc_resolution( uint8_t type )
+{
+    const lora_enc_type_info_t *info = _enc_type( type );
+
+    return info ? info->resolution : 1.0;
+}
+
+const char *lora_enc_type_name( uint8_t type )
+{
+    const lora_enc_type_info_t *info = _enc_type( type );
+
+    return info ? info->name : "unknown";
+}
+/******************************************************************************
+*  LoRa ENC VARINT
+*******************************************************************************/
+size_t lora_enc_uvarint_put( uint8_t *out, uint32_t value )
+{
+    size_t len = 0;
+
+    while( value >= 0x80 )
+    {
+        out[ len++ ] = ( uint8_t )( value | 0x80 );
+        value >>= 7;
+    }
+
+    out[ len++ ] = ( uint8_t )value;
+    return len;
+}
+
+ssize_t lora_enc_uvarint_get( const uint8_t *in, size_t len, uint32_t *value )
+{
+    uint32_t z = 0;
+
+    for( size_t i = 0; i < len && i < 5; i++ )
+    {
+        z |= ( uint32_t )( in[ i ] & 0x7F ) << ( 7 * i );
+
+        if( !( in[ i ] & 0x80 ) )
+        {
+            *value = z;
+            return ( ssize_t )( i + 1 );
+        }
+    }
+
+    return -1;
+}
+
+size_t lora_enc_varint_put( uint8_t *out, int32_t value )
+{
+    return lora_enc_uvarint_put( out, _enc_zigzag( value ) );
+}
+
+ssize_t lora_enc_varint_get( const uint8_t *in, size_t len, int32_t *value )
+{
+    uint32_t z;
+    ssize_t used = lora_enc_uvarint_get( in, len, &z );
+
+    if( used > 0 )
+        *value = _enc_unzigzag( z );
+
+    return used;
+}
+/******************************************************************************
+*  LoRa ENC INIT
+*******************************************************************************/
+void lora_enc_init( lora_enc_t *enc, const lora_enc_field_t *schema, size_t count )
+{
+    memset( enc, 0, sizeof( *enc ) );
+
+    enc->schema = schema;
+    enc->count  = count < LORA_ENC_MAX_FIELDS ? count : LORA_ENC_MAX_FIELDS;
+}
+/******************************************************************************
+*  LoRa ENC FRAME
+*******************************************************************************/
+ssize_t lora_enc_frame( lora_enc_t *enc, const double *values, uint8_t *out, size_t size )
+{
+    uint8_t frame[ LORA_ENC_MAX_FRAME_SIZE ];
+    int32_t raw[ LORA_ENC_MAX_FIELDS ];
+    lora_enc_frame_t *sent;
+    bool delta = enc->ref.valid && enc->since_key < LORA_ENC_KEYFRAME_INTERVAL &&
+                 enc->ref_age < LORA_ENC_REF_WINDOW;
+    size_t len = 0;
+
+    for( size_t i = 0; i < enc->count; i++ )
+    {
+        double q = round( values[ i ] / lora_enc_resolution( enc->schema[ i ].type ) );
+        int64_t diff;
+
+        /* Written this way, NaN is out of range too */
+        if( !( q >= INT32_MIN && q <= INT32_MAX ) )
+            return -1;
+
+        raw[ i ]    = ( int32_t )q;
+        diff        = ( int64_t )raw[ i ] - enc->ref.raw[ i ];
+
+        /* A step beyond int32_t goes in a key frame */
+        if( diff < INT32_MIN || diff > INT32_MAX )
+            delta = false;
+    }
+
+    frame[ len++ ] = ( uint8_t )( ( delta ? LORA_ENC_HDR_DELTA : 0 ) | enc->seq );
+
+    if( delta )
+        frame[ len++ ] = enc->ref.seq;
+
+    for( size_t i = 0; i < enc->count; i++ )
+        len += lora_enc_varint_put( frame + len, delta ? raw[ i ] - enc->ref.raw[ i ] : raw[ i ] );
+
+    if( len > size )
+        return -1;
+
+    memcpy( out, frame, len );
+
+    /* Only a frame that was produced may become a reference */
+    sent = &enc->history[ enc->seq % LORA_ENC_HISTORY ];
+    memcpy( sent->raw, raw, enc->count * sizeof( raw[ 0 ] ) );
+
+    sent->valid     = true;
+    sent->seq       = enc->seq;
+    enc->seq        = ( uint8_t )( ( enc->seq + 1 ) & LORA_ENC_SEQ_MASK );
+    enc->since_key  = delta ? enc->since_key + 1 : 0;
+    enc->ref_age++;
+
+    return ( ssize_t )len;
+}
+/******************************************************************************
+*  LoRa ENC ACK
+*******************************************************************************/
+void lora_enc_ack( lora_enc_t *enc, uint8_t seq )
+{
+    lora_enc_frame_t *sent = &enc->history[ seq % LORA_ENC_HISTORY ];
+
+    /* Older than the history: keep the current reference */
+    if( sent->valid && sent->seq == seq )
+    {
+        enc->ref        = *sent;
+        enc->ref_age    = ( enc->seq - seq ) & LORA_ENC_SEQ_MASK;
+    }
+}
+
+/*
+ * Acknowledges an uplink carrying one or more records of this encoder:
+ * the newest one, last in the frame, becomes the reference. */
+void lora_enc_ack_frame( lora_enc_t *enc, const uint8_t *frame, size_t len )
+{
+    size_t pos = 0;
+    int newest = -1;
+
+    while( pos < len )
+    {
+        uint8_t hdr = frame[ pos++ ];
+
+        if( ( hdr & LORA_ENC_HDR_DELTA ) && pos++ >= len )
+            break;
+
+        for( size_t i = 0; i < enc->count; i++ )
+        {
+            int32_t value;
+            ssize_t used = lora_enc_varint_get( frame + pos, len - pos, &value );
+
+            if( used < 0 )
+                return;
+
+            pos += ( size_t )used;
+        }
+
+        newest = hdr & LORA_ENC_SEQ_MASK;
+    }
+
+    if( newest >= 0 )
+        lora_enc_ack( enc, ( uint8_t )newest );
+}
+
+void lora_enc_keyframe( lora_enc_t *enc )
+{
+    enc->ref.valid = false;
+}
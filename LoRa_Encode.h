@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Fields per Schema */
+#define LORA_ENC_MAX_FIELDS 16
+
+/**
+ * Reference Window: a delta frame never refers further back than this, so
+ * a receiver keeping as many frames always holds the reference */
+#define LORA_ENC_REF_WINDOW 32
+
+/**
+ * Encoded Frames remembered until one is acknowledged. An uplink is acked
+ * after the next batch started filling: the history spans the reference
+ * window, which holds more records than a batch at any rate. An ack for an
+ * older frame leaves the reference as it is, it could not serve anyway */
+#define LORA_ENC_HISTORY LORA_ENC_REF_WINDOW
+
+/**
+ * Delta Frames between two absolute ( key ) frames */
+#define LORA_ENC_KEYFRAME_INTERVAL 16
+
+/**
+ * Longest Frame: header, reference, one 5 byte varint per field. It may
+ * exceed the payload of the slow data rates: callers pass the room of the
+ * rate in use, lora_airtime_max_payload */
+#define LORA_ENC_MAX_FRAME_SIZE ( 2 + 5 * LORA_ENC_MAX_FIELDS )
+
+/**
+ * Frame Header: delta flag and 7 bit sequence number, followed by the
+ * reference sequence number in delta frames */
+#define LORA_ENC_HDR_DELTA  0x80
+#define LORA_ENC_SEQ_MASK   0x7F
+
+/**
+ * @brief Field types, Cayenne LPP type ids and resolutions
+ */
+typedef enum {
+    LORA_ENC_DIGITAL_IN     = 0x00,     /* 1            */
+    LORA_ENC_DIGITAL_OUT    = 0x01,     /* 1            */
+    LORA_ENC_ANALOG_IN      = 0x02,     /* 0.01         */
+    LORA_ENC_ANALOG_OUT     = 0x03,     /* 0.01         */
+    LORA_ENC_ILLUMINANCE    = 0x65,     /* 1 lux        */
+    LORA_ENC_PRESENCE       = 0x66,     /* 1            */
+    LORA_ENC_TEMPERATURE    = 0x67,     /* 0.1 degC     */
+    LORA_ENC_HUMIDITY       = 0x68,     /* 0.5 %RH      */
+    LORA_ENC_BAROMETER      = 0x73      /* 0.1 hPa      */
+} lora_enc_type_t;
+
+/**
+ * @brief Schema entry, fields are encoded in schema order
+ */
+typedef struct {
+    uint8_t channel;
+    uint8_t type;               /* lora_enc_type_t */
+} lora_enc_field_t;
+
+/**
+ * @brief Quantized values of one frame
+ */
+typedef struct {
+    bool        valid;
+    uint8_t     seq;
+    int32_t     raw[ LORA_ENC_MAX_FIELDS ];
+} lora_enc_frame_t;
+
+/**
+ * @brief Encoder state
+ *
+ * Delta frames are relative to the last acknowledged frame, which the
+ * receiver is known to have, so a lost uplink never breaks the chain.
+ */
+typedef struct {
+    const lora_enc_field_t  *schema;
+    size_t                  count;
+    uint8_t                 seq;                            /* next sequence number */
+    uint8_t                 since_key;
+    uint32_t                ref_age;                        /* frames since the ref */
+    lora_enc_frame_t        ref;                            /* last acknowledged    */
+    lora_enc_frame_t        history[ LORA_ENC_HISTORY ];    /* sent, not yet acked  */
+} lora_enc_t;
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa ENC TYPES
+*******************************************************************************/
+double lora_enc_resolution( uint8_t type );
+const char *lora_enc_type_name( uint8_t type );
+/******************************************************************************
+*  LoRa ENC VARINT
+*******************************************************************************/
+size_t lora_enc_varint_put( uint8_t *out, int32_t value );
+ssize_t lora_enc_varint_get( const uint8_t *in, size_t len, int32_t *value );
+size_t lora_enc_uvarint_put( uint8_t *out, uint32_t value );
+ssize_t lora_enc_uvarint_get( const uint8_t *in, size_t len, uint32_t *value );
+/******************************************************************************
+*  LoRa ENC INIT
+*******************************************************************************/
+void lora_enc_init( lora_enc_t *enc, const lora_enc_field_t *schema, size_t count );
+/******************************************************************************
+*  LoRa ENC FRAME
+*
+*  Returns the frame length, or -1 when the frame is longer than size or a
+*  value does not fit int32_t at its resolution. A failed frame changes
+*  nothing in the encoder.
+*******************************************************************************/
+ssize_t lora_enc_frame( lora_enc_t *enc, const double *values, uint8_t *out, size_t size );
+/******************************************************************************
+*  LoRa ENC ACK
+*******************************************************************************/
+void lora_enc_ack( lora_enc_t *enc, uint8_t seq );
+void lora_enc_ack_frame( lora_enc_t *enc, const uint8_t *frame, size_t len );
+void lora_enc_keyframe( lora_enc_t *enc );
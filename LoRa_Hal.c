@@ -4,25 +4,34 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <poll.h>
 #include <time.h>
 
 #include <applibs/log.h>
 #include <applibs/uart.h>
 #include <applibs/gpio.h>
+#include <applibs/storage.h>
 
 #include "peripheral_utilities.h"
 #include "LoRa_ChipConfig.h"
-
-static int UART_FD;
-static int RST_FD;
-static int CS_FD;
+#include "LoRa_Hal.h"
 
 /** @defgroup LORA_HAL_UART HAL UART Interface */             /** @{ */
 
+/**
+ * @brief Fills the bindings of the default module, click socket 1
+ */
+void LoRa_hal_cfgSetup(lora_hal_cfg_t *cfg) {
+  cfg->uart = LORA_UART_RXTX;
+  cfg->rst = LORA_UART_RST;
+  cfg->cs = LORA_UART_CS;
+  cfg->path = NULL;
+}
+
 /**
  * @brief Map UART Function Pointers
  */
-bool LoRa_hal_uartMap(void) {
+bool LoRa_hal_uartMap(lora_hal_t *hal, const lora_hal_cfg_t *cfg) {
   // Create a UART_Config object, open the UART and set up UART event handler
   UART_Config uartConfig;
   UART_InitConfig(&uartConfig);
@@ -33,9 +42,9 @@ bool LoRa_hal_uartMap(void) {
   uartConfig.stopBits = UART_StopBits_One;
   uartConfig.flowControl = UART_FlowControl_None;
 
-  UART_FD = UART_Open(LORA_UART_RXTX, &uartConfig);
+  hal->uart_fd = UART_Open(cfg->uart, &uartConfig);
 
-  if (UART_FD == -1) {
+  if (hal->uart_fd == -1) {
     Log_Debug("ERROR: Could not open UART: %s (%d).\n", strerror(errno), errno);
     return false;
   }
@@ -43,20 +52,40 @@ bool LoRa_hal_uartMap(void) {
   return true;
 }
 
+/**
+ * @brief Returns the UART file descriptor, for event loop registration
+ */
+int LoRa_hal_uartFd(lora_hal_t *hal) {
+  return hal->uart_fd;
+}
+
+/**
+ * @brief Opens the persistent storage of the driver, the application mutable storage
+ */
+int LoRa_hal_storageOpen(void) {
+  int fd = Storage_OpenMutableFile();
+
+  if (fd == -1) {
+    Log_Debug("ERROR: Could not open mutable storage: %s (%d).\n", strerror(errno), errno);
+  }
+
+  return fd;
+}
+
 /**
  * @brief Map UART GPIO Pointers (CS, RST Pin)
  */
-bool LoRa_hal_gpio_gpioMap(void){ 
-  RST_FD = GPIO_OpenAsOutput(LORA_UART_RST, GPIO_OutputMode_PushPull, GPIO_Value_High);
+bool LoRa_hal_gpio_gpioMap(lora_hal_t *hal, const lora_hal_cfg_t *cfg){ 
+  hal->rst_fd = GPIO_OpenAsOutput(cfg->rst, GPIO_OutputMode_PushPull, GPIO_Value_High);
 
-  if (RST_FD == -1) {
+  if (hal->rst_fd == -1) {
     Log_Debug("ERROR: Could not open rst GPIO: %s (%d).\n", strerror(errno), errno);
     return false;
   }
 
-  CS_FD = GPIO_OpenAsOutput(LORA_UART_CS, GPIO_OutputMode_PushPull, GPIO_Value_Low);
+  hal->cs_fd = GPIO_OpenAsOutput(cfg->cs, GPIO_OutputMode_PushPull, GPIO_Value_Low);
 
-  if (CS_FD == -1) {
+  if (hal->cs_fd == -1) {
       Log_Debug("ERROR: Could not open cst GPIO: %s (%d).\n", strerror(errno), errno);
       return false;
   }
@@ -67,25 +96,26 @@ bool LoRa_hal_gpio_gpioMap(void){
 /**
  * @brief Closes the LoRa UAR and GPIO Pointers
  */
-void LoRa_hal_close(void)
+void LoRa_hal_close(lora_hal_t *hal)
 {
-  CloseFdAndPrintError(UART_FD, "LORA_UART_RXTX");
-  CloseFdAndPrintError(CS_FD, "LORA_UART_CS");
-  CloseFdAndPrintError(RST_FD, "LORA_UART_RST");
+  CloseFdAndPrintError(hal->uart_fd, "LORA_UART_RXTX");
+  CloseFdAndPrintError(hal->cs_fd, "LORA_UART_CS");
+  CloseFdAndPrintError(hal->rst_fd, "LORA_UART_RST");
+  hal->uart_fd = hal->cs_fd = hal->rst_fd = -1;
 }
 
 /**
  * @brief Sets the CS Pin at the input level
  */
-void LoRa_hal_gpio_csSet(uint8_t input){ 
-  GPIO_SetValue(CS_FD, input);
+void LoRa_hal_gpio_csSet(lora_hal_t *hal, uint8_t input){ 
+  GPIO_SetValue(hal->cs_fd, input);
 }
 
 /**
  * @brief Sets the RST Pin at the input level
  */
-void LoRa_hal_gpio_rstSet(uint8_t input){ 
-  GPIO_SetValue(RST_FD, input);
+void LoRa_hal_gpio_rstSet(lora_hal_t *hal, uint8_t input){ 
+  GPIO_SetValue(hal->rst_fd, input);
 }
 
 /**
@@ -95,8 +125,8 @@ void LoRa_hal_gpio_rstSet(uint8_t input){
  *
  * Function writes one byte on UART.
  */
-void LoRa_hal_uartWrite(uint8_t input) {
-  write(UART_FD, &input, 1);
+void LoRa_hal_uartWrite(lora_hal_t *hal, uint8_t input) {
+  write(hal->uart_fd, &input, 1);
 }
 
 /**
@@ -106,7 +136,66 @@ void LoRa_hal_uartWrite(uint8_t input) {
  *
  * Function reads one byte.
  */
-ssize_t LoRa_hal_uartRead(uint8_t *ret)
+ssize_t LoRa_hal_uartRead(lora_hal_t *hal, uint8_t *ret)
+{
+  return read(hal->uart_fd, ret, 1);
+}
+
+/**
+ * @brief hal_uartWriteBuf
+ *
+ * @param[in] buffer tx data
+ * @param[in] len    number of bytes to send
+ *
+ * @return true when every byte has been handed to the UART
+ *
+ * Function writes the whole span, resuming after partial writes. It
+ * gives up when the UART takes nothing for LORA_HAL_WRITE_TIMEOUT_MS.
+ */
+bool LoRa_hal_uartWriteBuf(lora_hal_t *hal, const uint8_t *buffer, size_t len)
+{
+  struct pollfd pfd = { .fd = hal->uart_fd, .events = POLLOUT };
+
+  while (len > 0) {
+    ssize_t written = write(hal->uart_fd, buffer, len);
+
+    if (written > 0) {
+      buffer += written;
+      len -= (size_t)written;
+      continue;
+    }
+
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+
+    // The UART is non-blocking: wait for the TX FIFO to drain, not forever
+    if (written < 0 && errno == EAGAIN) {
+      if (poll(&pfd, 1, LORA_HAL_WRITE_TIMEOUT_MS) == 0) {
+        Log_Debug("ERROR: UART still full after %d ms.\n", LORA_HAL_WRITE_TIMEOUT_MS);
+        return false;
+      }
+      continue;
+    }
+
+    Log_Debug("ERROR: Could not write to UART: %s (%d).\n", strerror(errno), errno);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief hal_uartReadBuf
+ *
+ * @param[out] buffer rx data
+ * @param[in]  len    capacity of buffer
+ *
+ * @return number of bytes read, 0 or -1 (EAGAIN) when nothing is pending
+ *
+ * Function reads as many pending bytes as fit in one call.
+ */
+ssize_t LoRa_hal_uartReadBuf(lora_hal_t *hal, uint8_t *buffer, size_t len)
 {
-  return read(UART_FD, ret, 1);
+  return read(hal->uart_fd, buffer, len);
 }
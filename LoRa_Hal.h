@@ -1,32 +1,78 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Longest wait for the UART to take more bytes, in ms: a transmitter that
+ * stays full fails the write instead of blocking the caller */
+#define LORA_HAL_WRITE_TIMEOUT_MS 100
+
+/**
+ * @brief Bindings of one module: UART and GPIO ids on the device, or a
+ * serial device path on the host backend
+ */
+typedef struct {
+    int         uart;
+    int         rst;
+    int         cs;
+    const char *path;
+} lora_hal_cfg_t;
+
+/**
+ * @brief Descriptors of one module, opened by the map functions
+ */
+typedef struct {
+    int         uart_fd;
+    int         rst_fd;
+    int         cs_fd;
+    const char *path;
+} lora_hal_t;
+
+/**
+ * @brief Fills the bindings of the default module
+ */
+void LoRa_hal_cfgSetup(lora_hal_cfg_t *cfg);
 
 /**
  * @brief Map UART Function Pointers
  */
-bool LoRa_hal_uartMap(void);
+bool LoRa_hal_uartMap(lora_hal_t *hal, const lora_hal_cfg_t *cfg);
+
+/**
+ * @brief Returns the UART file descriptor, for event loop registration
+ */
+int LoRa_hal_uartFd(lora_hal_t *hal);
+
+/**
+ * @brief Opens the persistent storage of the driver
+ *
+ * @return read/write file descriptor, or -1. The caller closes it.
+ */
+int LoRa_hal_storageOpen(void);
 
 /**
- * @brief Closes the LoRa UAR and GPIO Pointers
+ * @brief Closes the LoRa UART and GPIO Pointers
  */
-void LoRa_hal_close(void);
+void LoRa_hal_close(lora_hal_t *hal);
 
 /**
  * @brief Map UART GPIO Pointers (CS, RST Pin)
  */
-bool LoRa_hal_gpio_gpioMap(void);
+bool LoRa_hal_gpio_gpioMap(lora_hal_t *hal, const lora_hal_cfg_t *cfg);
 
 /**
  * @brief Sets the CS Pin at the input level
  */
-void LoRa_hal_gpio_csSet(uint8_t input);
+void LoRa_hal_gpio_csSet(lora_hal_t *hal, uint8_t input);
 
 /**
  * @brief Sets the RST Pin at the input level
  */
-void LoRa_hal_gpio_rstSet(uint8_t input);
+void LoRa_hal_gpio_rstSet(lora_hal_t *hal, uint8_t input);
 
 /**
  * @brief hal_uartWrite
@@ -35,7 +81,7 @@ void LoRa_hal_gpio_rstSet(uint8_t input);
  *
  * Function writes one byte on UART.
  */
-void LoRa_hal_uartWrite(uint8_t input);
+void LoRa_hal_uartWrite(lora_hal_t *hal, uint8_t input);
 
 /**
  * @brief hal_uartRead
@@ -44,4 +90,29 @@ void LoRa_hal_uartWrite(uint8_t input);
  *
  * Function reads one byte.
  */
-ssize_t LoRa_hal_uartRead(uint8_t *ret);
\ No newline at end of file
+ssize_t LoRa_hal_uartRead(lora_hal_t *hal, uint8_t *ret);
+
+/**
+ * @brief hal_uartWriteBuf
+ *
+ * @param[in] buffer tx data
+ * @param[in] len    number of bytes to send
+ *
+ * @return true when every byte has been handed to the UART
+ *
+ * Function writes the whole span, resuming after partial writes. It
+ * gives up when the UART takes nothing for LORA_HAL_WRITE_TIMEOUT_MS.
+ */
+bool LoRa_hal_uartWriteBuf(lora_hal_t *hal, const uint8_t *buffer, size_t len);
+
+/**
+ * @brief hal_uartReadBuf
+ *
+ * @param[out] buffer rx data
+ * @param[in]  len    capacity of buffer
+ *
+ * @return number of bytes read, 0 or -1 (EAGAIN) when nothing is pending
+ *
+ * Function reads as many pending bytes as fit in one call.
+ */
+ssize_t LoRa_hal_uartReadBuf(lora_hal_t *hal, uint8_t *buffer, size_t len);
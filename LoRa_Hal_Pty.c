@@ -0,0 +1,191 @@
+/* Pseudo-terminal backend of LoRa_Hal.h, for host builds: the module is
+   reached through a serial device (usually the slave side of the RN2483
+   simulator in host/), the reset line maps to "sys reset" and the chip
+   select is a no-op. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h> 
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <applibs/log.h>
+
+#include "peripheral_utilities.h"
+#include "LoRa_Hal.h"
+
+/** @defgroup LORA_HAL_PTY HAL Pseudo-Terminal Interface */   /** @{ */
+
+/**
+ * @brief Fills the bindings of the default module: the LORA_PTY device
+ */
+void LoRa_hal_cfgSetup(lora_hal_cfg_t *cfg) {
+  cfg->uart = -1;
+  cfg->rst = -1;
+  cfg->cs = -1;
+  cfg->path = NULL;
+}
+
+/**
+ * @brief Map UART Function Pointers
+ */
+bool LoRa_hal_uartMap(lora_hal_t *hal, const lora_hal_cfg_t *cfg) {
+  const char *path = cfg->path ? cfg->path : getenv("LORA_PTY");
+  struct termios tio;
+
+  if (path == NULL) {
+    Log_Debug("ERROR: No LoRa serial device, set LORA_PTY.\n");
+    return false;
+  }
+
+  hal->path = path;
+  hal->uart_fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+  if (hal->uart_fd == -1) {
+    Log_Debug("ERROR: Could not open %s: %s (%d).\n", path, strerror(errno), errno);
+    return false;
+  }
+
+  // Same framing as the device: 57600 8N1, raw
+  if (tcgetattr(hal->uart_fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, B57600);
+    tcsetattr(hal->uart_fd, TCSANOW, &tio);
+  }
+
+  return true;
+}
+
+/**
+ * @brief Returns the UART file descriptor, for event loop registration
+ */
+int LoRa_hal_uartFd(lora_hal_t *hal) {
+  return hal->uart_fd;
+}
+
+/**
+ * @brief Opens the persistent storage of the driver, a file named by LORA_STORAGE
+ */
+int LoRa_hal_storageOpen(void) {
+  const char *path = getenv("LORA_STORAGE");
+  int fd = open(path ? path : "lora_storage.bin", O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+  if (fd == -1) {
+    Log_Debug("ERROR: Could not open LoRa storage: %s (%d).\n", strerror(errno), errno);
+  }
+
+  return fd;
+}
+
+/**
+ * @brief Map UART GPIO Pointers (CS, RST Pin)
+ */
+bool LoRa_hal_gpio_gpioMap(lora_hal_t *hal, const lora_hal_cfg_t *cfg) {
+  hal->rst_fd = -1;
+  hal->cs_fd = -1;
+  return true;
+}
+
+/**
+ * @brief Closes the LoRa UAR and GPIO Pointers
+ */
+void LoRa_hal_close(lora_hal_t *hal)
+{
+  CloseFdAndPrintError(hal->uart_fd, "LORA_PTY");
+  hal->uart_fd = -1;
+}
+
+/**
+ * @brief Sets the CS Pin at the input level
+ */
+void LoRa_hal_gpio_csSet(lora_hal_t *hal, uint8_t input) {
+}
+
+/**
+ * @brief Sets the RST Pin at the input level
+ *
+ * There is no reset line to the simulator: releasing it sends "sys reset",
+ * which gets the same boot banner as a module coming out of reset.
+ */
+void LoRa_hal_gpio_rstSet(lora_hal_t *hal, uint8_t input) {
+  static const char reset[] = "sys reset\r\n";
+
+  if (input && write(hal->uart_fd, reset, sizeof(reset) - 1) == -1) {
+    Log_Debug("ERROR: Could not reset the LoRa simulator: %s (%d).\n", strerror(errno), errno);
+  }
+}
+
+/**
+ * @brief hal_uartWrite
+ *
+ * @param[in] input tx data byte
+ *
+ * Function writes one byte on UART.
+ */
+void LoRa_hal_uartWrite(lora_hal_t *hal, uint8_t input) {
+  LoRa_hal_uartWriteBuf(hal, &input, 1);
+}
+
+/**
+ * @brief hal_uartRead
+ *
+ * @return rx data byte
+ *
+ * Function reads one byte.
+ */
+ssize_t LoRa_hal_uartRead(lora_hal_t *hal, uint8_t *ret)
+{
+  return read(hal->uart_fd, ret, 1);
+}
+
+/**
+ * @brief hal_uartWriteBuf
+ *
+ * Function writes the whole span, resuming after partial writes.
+ */
+bool LoRa_hal_uartWriteBuf(lora_hal_t *hal, const uint8_t *buffer, size_t len)
+{
+  struct pollfd pfd = { .fd = hal->uart_fd, .events = POLLOUT };
+
+  while (len > 0) {
+    ssize_t written = write(hal->uart_fd, buffer, len);
+
+    if (written > 0) {
+      buffer += written;
+      len -= (size_t)written;
+      continue;
+    }
+
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (written < 0 && errno == EAGAIN) {
+      if (poll(&pfd, 1, LORA_HAL_WRITE_TIMEOUT_MS) == 0) {
+        Log_Debug("ERROR: UART still full after %d ms.\n", LORA_HAL_WRITE_TIMEOUT_MS);
+        return false;
+      }
+      continue;
+    }
+
+    Log_Debug("ERROR: Could not write to %s: %s (%d).\n", hal->path, strerror(errno), errno);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief hal_uartReadBuf
+ *
+ * Function reads as many pending bytes as fit in one call.
+ */
+ssize_t LoRa_hal_uartReadBuf(lora_hal_t *hal, uint8_t *buffer, size_t len)
+{
+  return read(hal->uart_fd, buffer, len);
+}
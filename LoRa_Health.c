@@ -0,0 +1,211 @@
+#include "LoRa_Health.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "LoRa_Log.h"
+#include "LoRa_Session.h"
+
+static lora_ctx_t*          _lora;
+static lora_health_status_t _status;
+static lora_health_state_t  _first;         /* step the next recovery starts at */
+static uint32_t             _successes;
+static struct timespec      _start;
+static lora_health_cb       _cb;
+static void*                _context;
+
+static char LORA_CMD_SYS_GET_VER[]  = "sys get ver";
+static char LORA_CMD_SYS_RESET[]    = "sys reset";
+static char LORA_CMD_MAC_RESUME[]   = "mac resume";
+
+static void _health_step( lora_health_state_t state );
+
+/*
+ * Answers that say nothing about the module being alive are not failures:
+ * no_free_ch, denied, not_joined... come from a working MAC. */
+static bool _health_failed( uint8_t result )
+{
+    return result == LORA_ERR_TIMEOUT || result == LORA_ERR_MAC_PAUSED || result == LORA_ERR_BUSY ||
+           result == LORA_ERR_IO;
+}
+
+static bool _health_banner( uint8_t result, const lora_rsp_view_t *rsp )
+{
+    return result == LORA_OK && lora_banner( rsp->line );
+}
+
+static void _health_done( bool recovered, bool session_lost )
+{
+    struct timespec now;
+    lora_health_status_t status;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    _status.reached         = _status.state;
+    _status.recovered_f     = recovered;
+    _status.session_lost_f  = session_lost;
+    _status.recovery_ms     = ( uint32_t )( ( now.tv_sec - _start.tv_sec ) * 1000 +
+                                            ( now.tv_nsec - _start.tv_nsec ) / 1000000 );
+    _status.state           = LORA_HEALTH_OK;
+    _status.failures        = 0;
+    _successes              = 0;
+
+    if( recovered )
+        _status.recoveries++;
+
+    /* Failing again soon: what was done did not hold, start a step further */
+    if( _first == LORA_HEALTH_PROBE )
+        _first = LORA_HEALTH_SOFT_RESET;
+    else
+        _first = LORA_HEALTH_HARD_RESET;
+
+    LORA_LOG_INFO("[INFO] LoRa recovery %s after %u ms, step %u%s\n", recovered ? "done" : "failed",
+                  _status.recovery_ms, _status.reached, session_lost ? ", session lost" : "");
+
+    status = _status;
+
+    if( _cb )
+        _cb( &status, _context );
+}
+
+static void _health_restore_cb( uint8_t result, void *context )
+{
+    /* Still silent after the reset line: the next failures try again */
+    if( result == LORA_ERR_TIMEOUT )
+        _health_done( false, false );
+    else
+        _health_done( true, result != LORA_OK );
+}
+
+static void _health_reset_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    if( _status.state == LORA_HEALTH_SOFT_RESET && !_health_banner( result, rsp ) )
+    {
+        _health_step( LORA_HEALTH_HARD_RESET );
+        return;
+    }
+
+    /* The reset line is the last resort: without a banner, try the session anyway */
+    _health_step( LORA_HEALTH_RESTORE );
+}
+
+static void _health_resume_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    if( result )
+        _health_step( LORA_HEALTH_SOFT_RESET );
+    else
+        _health_done( true, false );
+}
+
+static void _health_probe_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    /* Not even a sys command answered: a soft reset would not be heard either */
+    if( !_health_banner( result, rsp ) )
+        _health_step( LORA_HEALTH_HARD_RESET );
+    else
+        _health_step( LORA_HEALTH_RESUME );
+}
+
+/*
+ * Each step is submitted from a completion, while the engine is free:
+ * nothing queued by the application gets in between. */
+static void _health_step( lora_health_state_t state )
+{
+    bool submitted = false;
+
+    _status.state = state;
+    LORA_LOG_DEBUG("[DEBUG] LoRa recovery step %u\n", state);
+
+    switch( state )
+    {
+    case LORA_HEALTH_PROBE:
+        submitted = lora_cmd_async( _lora, LORA_CMD_SYS_GET_VER, _health_probe_cb, NULL );
+        break;
+
+    case LORA_HEALTH_RESUME:
+        submitted = lora_cmd_async( _lora, LORA_CMD_MAC_RESUME, _health_resume_cb, NULL );
+        break;
+
+    case LORA_HEALTH_SOFT_RESET:
+        submitted = lora_cmd_async( _lora, LORA_CMD_SYS_RESET, _health_reset_cb, NULL );
+        break;
+
+    case LORA_HEALTH_HARD_RESET:
+        submitted = lora_reset_async( _lora, _health_reset_cb, NULL );
+        break;
+
+    case LORA_HEALTH_RESTORE:
+        if( lora_session_restore_async( _health_restore_cb, NULL ) )
+            return;
+
+        /* No stored session: the application joins again */
+        _health_done( true, true );
+        return;
+
+    default:
+        return;
+    }
+
+    if( !submitted )
+        _health_done( false, false );
+}
+
+static void _health_result( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    /* The recovery's own commands are followed by their callbacks */
+    if( _status.state != LORA_HEALTH_OK )
+        return;
+
+    if( !_health_failed( result ) )
+    {
+        _status.failures = 0;
+
+        if( ++_successes >= LORA_HEALTH_STABLE )
+            _first = LORA_HEALTH_PROBE;
+        return;
+    }
+
+    _successes      = 0;
+    _status.result  = result;
+
+    if( ++_status.failures < LORA_HEALTH_FAILURES )
+        return;
+
+    LORA_LOG_WARN("[WARN] LoRa module failing, %u results %u in a row, recovering\n", _status.failures,
+                  result);
+
+    clock_gettime( CLOCK_MONOTONIC, &_start );
+    _health_step( _first );
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa HEALTH INIT
+*******************************************************************************/
+void lora_health_init( lora_ctx_t *lora, lora_health_cb cb, void *context )
+{
+    memset( &_status, 0, sizeof( _status ) );
+
+    _lora       = lora;
+    _cb         = cb;
+    _context    = context;
+    _first      = LORA_HEALTH_PROBE;
+    _successes  = 0;
+
+    lora_set_result_cb( _lora, _health_result, NULL );
+}
+/******************************************************************************
+*  LoRa HEALTH DEINIT
+*******************************************************************************/
+void lora_health_deinit()
+{
+    lora_set_result_cb( _lora, NULL, NULL );
+    _status.state = LORA_HEALTH_OK;
+}
+/******************************************************************************
+*  LoRa HEALTH STATUS
+*******************************************************************************/
+void lora_health_status( lora_health_status_t *status )
+{
+    *status = _status;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LoRa.h"
+
+/**
+ * Consecutive failed commands ( timeout, mac_paused, busy ) that start a recovery */
+#define LORA_HEALTH_FAILURES 3
+
+/**
+ * Successful commands after which the next recovery starts from the probe again */
+#define LORA_HEALTH_STABLE 8
+
+/**
+ * @brief Recovery step
+ *
+ * A recovery probes the module with "sys get ver" and resumes its MAC
+ * when it answers. One that does not answer gets the reset line, a MAC
+ * still failing after the resume gets "sys reset". A reset loses the
+ * MAC state, so the stored session is restored behind it. When failures
+ * come back soon after a recovery, the next one starts a step further.
+ */
+typedef enum {
+    LORA_HEALTH_OK = 0,         /* watching command results                */
+    LORA_HEALTH_PROBE,          /* sys get ver                             */
+    LORA_HEALTH_RESUME,         /* mac resume                              */
+    LORA_HEALTH_SOFT_RESET,     /* sys reset                               */
+    LORA_HEALTH_HARD_RESET,     /* reset line, lora_reset_async            */
+    LORA_HEALTH_RESTORE         /* stored session, lora_session_restore    */
+} lora_health_state_t;
+
+/**
+ * @brief Supervisor status
+ */
+typedef struct {
+    lora_health_state_t state;
+    uint32_t            failures;       /* consecutive failed commands     */
+    uint8_t             result;         /* result of the last failure      */
+    lora_health_state_t reached;        /* last step of the last recovery  */
+    bool                recovered_f;    /* the module answers again        */
+    bool                session_lost_f; /* reset, and no session restored  */
+    uint32_t            recoveries;     /* recoveries since init           */
+    uint32_t            recovery_ms;    /* duration of the last recovery   */
+} lora_health_status_t;
+
+/**
+ * @brief Recovery completion callback
+ *
+ * With session_lost_f the module was reset without a session to resume:
+ * the device has to join again.
+ */
+typedef void (*lora_health_cb)( const lora_health_status_t *status, void *context );
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa HEALTH INIT
+*******************************************************************************/
+void lora_health_init( lora_ctx_t *lora, lora_health_cb cb, void *context );
+/******************************************************************************
+*  LoRa HEALTH DEINIT
+*******************************************************************************/
+void lora_health_deinit(void);
+/******************************************************************************
+*  LoRa HEALTH STATUS
+*******************************************************************************/
+void lora_health_status( lora_health_status_t *status );
@@ -0,0 +1,228 @@
+#include "LoRa_Io.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "LoRa_Log.h"
+
+static void _io_signal( int fd )
+{
+    uint64_t one = 1;
+
+    /* Only fails when the counter saturates: the reader is signalled anyway */
+    ( void )!write( fd, &one, sizeof( one ) );
+}
+
+static void _io_drain_fd( int fd )
+{
+    uint64_t count;
+
+    ( void )!read( fd, &count, sizeof( count ) );
+}
+
+/*
+ * Writes everything queued. Blocks on the UART, which is the point of
+ * doing it here. */
+static void _io_transmit( lora_io_t *io )
+{
+    uint8_t *span;
+    size_t len;
+
+    while( ( len = lora_ring_read_span( io->tx, &span ) ) > 0 )
+    {
+        LoRa_hal_uartWriteBuf( io->hal, span, len );
+        lora_ring_release( io->tx, len );
+    }
+}
+
+/*
+ * Reads what the UART holds into the receive ring. Returns true when a
+ * line ended, the only thing worth waking the event loop for. */
+static bool _io_receive( lora_io_t *io )
+{
+    uint8_t overflow[ 64 ];
+    bool line_f = false;
+    uint8_t *span;
+    size_t room;
+    ssize_t len = 0;
+
+    for( ;; )
+    {
+        room = lora_ring_write_span( io->rx, &span );
+
+        /* Ahead of anything read after a loss, so the broken line is dropped whole */
+        if( room && io->rx_lost_f )
+        {
+            *span = LORA_IO_RX_BREAK;
+            lora_ring_commit( io->rx, 1 );
+            io->rx_lost_f = false;
+            continue;
+        }
+
+        /* Ring full: read anyway so the UART does not stall, and count the loss */
+        if( !room )
+        {
+            if( ( len = LoRa_hal_uartReadBuf( io->hal, overflow, sizeof( overflow ) ) ) <= 0 )
+                break;
+
+            atomic_fetch_add_explicit( &io->rx->overflows, ( uint32_t )len, memory_order_relaxed );
+            io->rx_lost_f = true;
+            line_f = true;
+            continue;
+        }
+
+        if( ( len = LoRa_hal_uartReadBuf( io->hal, span, room ) ) <= 0 )
+            break;
+
+        line_f |= memchr( span, '\n', ( size_t )len ) != NULL;
+        lora_ring_commit( io->rx, ( size_t )len );
+    }
+
+    if( len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+    {
+        LORA_LOG_ERROR("ERROR: Could not read LoRa UART: %s (%d).\n", strerror(errno), errno);
+        atomic_store( &io->failed_f, true );
+        return true;
+    }
+
+    return line_f;
+}
+
+static void *_io_thread( void *arg )
+{
+    lora_io_t *io = arg;
+    struct pollfd pfd[ 2 ] = {
+        { .fd = LoRa_hal_uartFd( io->hal ), .events = POLLIN },
+        { .fd = io->kick_fd,                .events = POLLIN }
+    };
+
+    while( !atomic_load( &io->stop_f ) && !atomic_load( &io->failed_f ) )
+    {
+        if( poll( pfd, 2, -1 ) < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+
+            LORA_LOG_ERROR("ERROR: Could not poll LoRa UART: %s (%d).\n", strerror(errno), errno);
+            atomic_store( &io->failed_f, true );
+            break;
+        }
+
+        if( pfd[ 1 ].revents & POLLIN )
+        {
+            _io_drain_fd( io->kick_fd );
+            _io_transmit( io );
+        }
+
+        if( pfd[ 0 ].revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+        {
+            LORA_LOG_ERROR("ERROR: LoRa UART hung up.\n");
+            atomic_store( &io->failed_f, true );
+            break;
+        }
+
+        if( ( pfd[ 0 ].revents & POLLIN ) && _io_receive( io ) )
+            _io_signal( io->event_fd );
+    }
+
+    /* Wake the event loop so a waiting command sees the failure */
+    _io_signal( io->event_fd );
+    return NULL;
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa IO INIT
+*******************************************************************************/
+void lora_io_init( lora_io_t *io )
+{
+    memset( io, 0, sizeof( *io ) );
+
+    io->event_fd    = -1;
+    io->kick_fd     = -1;
+}
+/******************************************************************************
+*  LoRa IO START
+*******************************************************************************/
+bool lora_io_start( lora_io_t *io, lora_hal_t *hal, lora_ring_t *rx, lora_ring_t *tx )
+{
+    int err;
+
+    if( io->running_f )
+        return false;
+
+    io->hal = hal;
+    io->rx  = rx;
+    io->tx  = tx;
+    atomic_store( &io->stop_f, false );
+    atomic_store( &io->failed_f, false );
+
+    io->event_fd    = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    io->kick_fd     = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+    if( io->event_fd == -1 || io->kick_fd == -1 )
+    {
+        LORA_LOG_ERROR("ERROR: Could not create LoRa I/O eventfd: %s (%d).\n", strerror(errno), errno);
+        lora_io_stop( io );
+        return false;
+    }
+
+    if( ( err = pthread_create( &io->thread, NULL, _io_thread, io ) ) != 0 )
+    {
+        LORA_LOG_ERROR("ERROR: Could not start LoRa I/O thread: %s (%d).\n", strerror(err), err);
+        lora_io_stop( io );
+        return false;
+    }
+
+    io->running_f = true;
+    return true;
+}
+/******************************************************************************
+*  LoRa IO STOP
+*******************************************************************************/
+void lora_io_stop( lora_io_t *io )
+{
+    if( io->running_f )
+    {
+        atomic_store( &io->stop_f, true );
+        _io_signal( io->kick_fd );
+        pthread_join( io->thread, NULL );
+        io->running_f = false;
+    }
+
+    if( io->event_fd != -1 )
+        close( io->event_fd );
+
+    if( io->kick_fd != -1 )
+        close( io->kick_fd );
+
+    io->event_fd    = -1;
+    io->kick_fd     = -1;
+}
+/******************************************************************************
+*  LoRa IO EVENTS
+*******************************************************************************/
+int lora_io_event_fd( lora_io_t *io )
+{
+    return io->event_fd;
+}
+
+void lora_io_ack( lora_io_t *io )
+{
+    _io_drain_fd( io->event_fd );
+}
+
+bool lora_io_failed( lora_io_t *io )
+{
+    return atomic_load( &io->failed_f );
+}
+/******************************************************************************
+*  LoRa IO KICK
+*******************************************************************************/
+void lora_io_kick( lora_io_t *io )
+{
+    _io_signal( io->kick_fd );
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LoRa_Hal.h"
+#include "LoRa_Ring.h"
+
+/**
+ * Receive Break: written to the receive ring where bytes were lost, the
+ * line it falls in is dropped. The module never sends a NUL */
+#define LORA_IO_RX_BREAK 0x00
+
+/**
+ * @brief Radio I/O thread
+ *
+ * The worker owns the UART: it writes what the event loop queues in the
+ * transmit ring, reads the module into the receive ring, and signals an
+ * eventfd once a whole line has arrived. The event loop never blocks on
+ * the serial link, both rings are single-producer / single-consumer.
+ * One worker per module, the state lives in the driver instance.
+ */
+typedef struct {
+    pthread_t       thread;
+    bool            running_f;
+    int             event_fd;       /* worker -> event loop: lines received */
+    int             kick_fd;        /* event loop -> worker: transmit, stop  */
+    atomic_bool     stop_f;
+    atomic_bool     failed_f;
+    lora_hal_t*     hal;
+    lora_ring_t*    rx;
+    lora_ring_t*    tx;
+    bool            rx_lost_f;      /* worker only: a break is owed to the ring */
+} lora_io_t;
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa IO INIT
+*******************************************************************************/
+void lora_io_init( lora_io_t *io );
+/******************************************************************************
+*  LoRa IO START
+*******************************************************************************/
+bool lora_io_start( lora_io_t *io, lora_hal_t *hal, lora_ring_t *rx, lora_ring_t *tx );
+/******************************************************************************
+*  LoRa IO STOP
+*******************************************************************************/
+void lora_io_stop( lora_io_t *io );
+/******************************************************************************
+*  LoRa IO EVENTS
+*******************************************************************************/
+int lora_io_event_fd( lora_io_t *io );
+void lora_io_ack( lora_io_t *io );
+bool lora_io_failed( lora_io_t *io );
+/******************************************************************************
+*  LoRa IO KICK
+*******************************************************************************/
+void lora_io_kick( lora_io_t *io );
@@ -0,0 +1,279 @@
+#include "LoRa_Join.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "eventloop_timer_utilities.h"
+#include "LoRa_Airtime.h"
+#include "LoRa_Log.h"
+
+#define LORA_JOIN_DR_COUNT 6   /* DR0 - DR5, the LoRa rates */
+
+static lora_ctx_t*          _lora;
+static lora_join_status_t   _status;
+static EventLoopTimer*      _attempt_timer;
+static lora_join_cb         _cb;
+static void*                _context;
+static uint32_t             _rng;
+static bool                 _seeded_f;
+static bool                 _seeding_f;
+
+static char                 _dr_cmd[ 16 ];
+static char                 _join_mode[] = "otaa";
+
+static char LORA_CMD_SYS_GET_HWEUI[] = "sys get hweui";
+
+/*
+ * xorshift32: the spread only has to differ between devices. The seed
+ * mixes the module EUI into the instant the application started: devices
+ * powered up together read the same clock. */
+static uint32_t _join_random( uint32_t range )
+{
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+
+    return range ? _rng % range : 0;
+}
+
+/*
+ * FNV-1a of the EUI hex, folded into the clock seed. */
+static void _join_seed( const char *eui )
+{
+    uint32_t hash = 2166136261u;
+
+    while( *eui )
+        hash = ( hash ^ ( uint8_t )*eui++ ) * 16777619u;
+
+    _rng ^= hash;
+
+    /* xorshift never leaves zero */
+    if( !_rng )
+        _rng = 0x9E3779B9u;
+}
+
+static void _join_arm( uint32_t delay_ms )
+{
+    /* A zero delay would disarm the timer instead of firing it */
+    uint32_t ms = delay_ms ? delay_ms : 1;
+    struct timespec delay = { .tv_sec = ms / 1000, .tv_nsec = ( ms % 1000 ) * 1000000 };
+
+    SetEventLoopTimerOneShot( _attempt_timer, &delay );
+}
+
+/*
+ * Data rate of an attempt: the fastest first, slower ones reach further. */
+static uint8_t _join_dr( uint32_t attempt )
+{
+    return ( uint8_t )( LORA_JOIN_DR_COUNT - 1 - ( attempt / LORA_JOIN_TRIES_PER_DR ) % LORA_JOIN_DR_COUNT );
+}
+
+/*
+ * Randomized exponential backoff: half the doubled delay, plus a random
+ * share of the other half, so failed devices drift apart. */
+static uint32_t _join_backoff( uint32_t attempts )
+{
+    uint32_t delay = LORA_JOIN_BACKOFF_MIN_MS;
+
+    for( uint32_t i = 1; i < attempts && delay < LORA_JOIN_BACKOFF_MAX_MS; i++ )
+        delay *= 2;
+
+    if( delay > LORA_JOIN_BACKOFF_MAX_MS )
+        delay = LORA_JOIN_BACKOFF_MAX_MS;
+
+    return delay / 2 + _join_random( delay / 2 );
+}
+
+static void _join_notify(void)
+{
+    lora_join_status_t status = _status;
+
+    if( _cb )
+        _cb( &status, _context );
+}
+
+static void _join_failed( uint8_t result )
+{
+    _status.attempts++;
+    _status.result      = result;
+    _status.dr          = _join_dr( _status.attempts );
+    _status.backoff_ms  = _join_backoff( _status.attempts );
+    _status.state       = LORA_JOIN_BACKOFF;
+
+    LORA_LOG_DEBUG("[DEBUG] join attempt %u failed ( %u ), next at DR%u in %u ms\n", _status.attempts,
+                   result, _status.dr, _status.backoff_ms);
+
+    _join_arm( _status.backoff_ms );
+    _join_notify();
+}
+
+static void _join_done_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    if( _status.state != LORA_JOIN_JOINING )
+        return;
+
+    /* The join request went on air whatever the answer */
+    if( rsp->type == LORA_RSP_ACCEPTED || rsp->type == LORA_RSP_DENIED )
+        lora_metrics_airtime( _lora, lora_airtime_charge( LORA_AIRTIME_JOIN_REQUEST_SIZE ) );
+
+    if( rsp->type != LORA_RSP_ACCEPTED )
+    {
+        _join_failed( result ? result : LORA_ERR_DENIED );
+        return;
+    }
+
+    /* The session keeps the data rate the join went through */
+    _status.state   = LORA_JOIN_JOINED;
+    _status.result  = LORA_OK;
+
+    _join_notify();
+}
+
+static void _join_dr_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    if( _status.state != LORA_JOIN_JOINING )
+        return;
+
+    if( result )
+    {
+        _join_failed( result );
+        return;
+    }
+
+    /* The join request, accepted or denied, is charged at this rate */
+    lora_airtime_set_dr( _status.dr );
+
+    if( !lora_join_async( _lora, _join_mode, _join_done_cb, NULL ) )
+    {
+        _status.state = LORA_JOIN_BACKOFF;
+        _join_arm( LORA_JOIN_BUSY_RETRY_MS );
+    }
+}
+
+/*
+ * First attempt, at a random point of the start spread. */
+static void _join_spread(void)
+{
+    _status.backoff_ms = _join_random( LORA_JOIN_START_SPREAD_MS );
+
+    _join_arm( _status.backoff_ms );
+}
+
+static void _join_seed_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    _seeding_f = false;
+
+    /* Without the EUI the clock seed alone is kept, the next start asks again */
+    if( !result && rsp->type == LORA_RSP_VALUE )
+    {
+        _join_seed( rsp->line );
+        _seeded_f = true;
+    }
+
+    if( _status.state == LORA_JOIN_BACKOFF )
+        _join_spread();
+}
+
+/*
+ * One attempt: set the data rate, then send the join request. */
+static void _join_attempt_event( EventLoopTimer *timer )
+{
+    uint32_t wait;
+
+    ConsumeEventLoopTimerEvent( timer );
+
+    if( _status.state != LORA_JOIN_BACKOFF )
+        return;
+
+    /* Over the duty-cycle budget: the module would answer no_free_ch */
+    if( ( wait = lora_airtime_wait_ms() ) > 0 )
+    {
+        _join_arm( wait );
+        return;
+    }
+
+    snprintf( _dr_cmd, sizeof( _dr_cmd ), "mac set dr %u", _status.dr );
+    _status.state = LORA_JOIN_JOINING;
+
+    if( !lora_cmd_async( _lora, _dr_cmd, _join_dr_cb, NULL ) )
+    {
+        _status.state = LORA_JOIN_BACKOFF;
+        _join_arm( LORA_JOIN_BUSY_RETRY_MS );
+    }
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa JOIN INIT
+*******************************************************************************/
+bool lora_join_init( lora_ctx_t *lora, EventLoop *event_loop, lora_join_cb cb, void *context )
+{
+    struct timespec now;
+
+    memset( &_status, 0, sizeof( _status ) );
+
+    _lora       = lora;
+    _cb         = cb;
+    _context    = context;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    _rng = ( uint32_t )now.tv_nsec ^ ( uint32_t )now.tv_sec << 16 ^ 0x9E3779B9u;
+    _seeded_f   = false;
+    _seeding_f  = false;
+
+    _attempt_timer = CreateEventLoopDisarmedTimer( event_loop, _join_attempt_event );
+
+    return _attempt_timer != NULL;
+}
+/******************************************************************************
+*  LoRa JOIN DEINIT
+*******************************************************************************/
+void lora_join_deinit()
+{
+    DisposeEventLoopTimer( _attempt_timer );
+    _attempt_timer  = NULL;
+    _status.state   = LORA_JOIN_IDLE;
+}
+/******************************************************************************
+*  LoRa JOIN START
+*******************************************************************************/
+void lora_join_start()
+{
+    if( _status.state == LORA_JOIN_BACKOFF || _status.state == LORA_JOIN_JOINING )
+        return;
+
+    _status.state       = LORA_JOIN_BACKOFF;
+    _status.attempts    = 0;
+    _status.dr          = _join_dr( 0 );
+    _status.backoff_ms  = 0;
+
+    /* The spread is drawn once the module EUI is in the seed */
+    if( _seeding_f )
+        return;
+
+    if( !_seeded_f && lora_cmd_async( _lora, LORA_CMD_SYS_GET_HWEUI, _join_seed_cb, NULL ) )
+    {
+        _seeding_f = true;
+        return;
+    }
+
+    _join_spread();
+}
+/******************************************************************************
+*  LoRa JOIN STOP
+*******************************************************************************/
+void lora_join_stop()
+{
+    DisarmEventLoopTimer( _attempt_timer );
+
+    /* A join in progress completes unnoticed */
+    _status.state = LORA_JOIN_IDLE;
+}
+/******************************************************************************
+*  LoRa JOIN STATUS
+*******************************************************************************/
+void lora_join_status( lora_join_status_t *status )
+{
+    *status = _status;
+}
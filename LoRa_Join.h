@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+#include "LoRa.h"
+
+/**
+ * First Attempt Spread ( ms ): devices powered up together do not join together.
+ * The draw is seeded with the module EUI ( sys get hweui ) and the clock */
+#define LORA_JOIN_START_SPREAD_MS 10000
+
+/**
+ * Backoff after the first failed attempt ( ms ), doubled after each failure */
+#define LORA_JOIN_BACKOFF_MIN_MS 15000
+
+/**
+ * Longest Backoff ( ms ) */
+#define LORA_JOIN_BACKOFF_MAX_MS 3600000
+
+/**
+ * Retry Delay ( ms ) while the driver is busy with another command */
+#define LORA_JOIN_BUSY_RETRY_MS 1000
+
+/**
+ * Attempts at each data rate, stepping from DR5 down to DR0 and around */
+#define LORA_JOIN_TRIES_PER_DR 2
+
+/**
+ * @brief Join state
+ */
+typedef enum {
+    LORA_JOIN_IDLE = 0,         /* not started, or stopped                 */
+    LORA_JOIN_BACKOFF,          /* waiting for the next attempt            */
+    LORA_JOIN_JOINING,          /* join request in progress                */
+    LORA_JOIN_JOINED
+} lora_join_state_t;
+
+/**
+ * @brief Join status
+ */
+typedef struct {
+    lora_join_state_t   state;
+    uint32_t            attempts;       /* failed attempts since the start */
+    uint8_t             dr;             /* data rate of the next attempt   */
+    uint8_t             result;         /* result of the last attempt      */
+    uint32_t            backoff_ms;     /* last backoff drawn              */
+} lora_join_status_t;
+
+/**
+ * @brief Join state change callback
+ *
+ * Invoked when an attempt completes: state is LORA_JOIN_JOINED, or
+ * LORA_JOIN_BACKOFF with the result of the failed attempt.
+ */
+typedef void (*lora_join_cb)( const lora_join_status_t *status, void *context );
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa JOIN INIT
+*******************************************************************************/
+bool lora_join_init( lora_ctx_t *lora, EventLoop *event_loop, lora_join_cb cb, void *context );
+/******************************************************************************
+*  LoRa JOIN DEINIT
+*******************************************************************************/
+void lora_join_deinit(void);
+/******************************************************************************
+*  LoRa JOIN START
+*
+*  The first start reads the module EUI to seed the spread, the first
+*  attempt follows within LORA_JOIN_START_SPREAD_MS of the answer.
+*******************************************************************************/
+void lora_join_start(void);
+/******************************************************************************
+*  LoRa JOIN STOP
+*******************************************************************************/
+void lora_join_stop(void);
+/******************************************************************************
+*  LoRa JOIN STATUS
+*******************************************************************************/
+void lora_join_status( lora_join_status_t *status );
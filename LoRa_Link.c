@@ -0,0 +1,312 @@
+#include "LoRa_Link.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LoRa_Airtime.h"
+#include "LoRa_Batch.h"
+#include "LoRa_Log.h"
+#include "LoRa_Uplink.h"
+
+/**
+ * No data rate change waiting */
+#define LORA_LINK_DR_NONE 0xFF
+
+static lora_ctx_t*          _lora;
+static lora_link_status_t   _status;
+static lora_link_cb         _cb;
+static void*                _context;
+
+/* Margins at the data rate _window_dr, a ring */
+static int16_t              _window[ LORA_LINK_WINDOW ];
+static uint8_t              _window_pos;
+static uint8_t              _window_dr;
+
+/* The module keeps the last margin until the next answer: after a change
+ * of data rate, that one still describes the old rate */
+static bool                 _stale_f;
+static int16_t              _stale_margin;
+
+static int16_t              _last_read;     /* margin read after the previous uplink */
+static bool                 _armed_f;       /* link checks enabled on the module */
+static uint8_t              _target_dr;     /* of the mac set dr in flight       */
+static uint8_t              _retry_dr;      /* not submitted, engine busy        */
+
+static lora_script_step_t   _steps[ 4 ];
+static char                 _linkchk_cmd[ 24 ];
+static char                 _dr_cmd[ 16 ];
+
+static char LORA_CMD_GET_MRGN[]     = "mac get mrgn";
+static char LORA_CMD_GET_GWNB[]     = "mac get gwnb";
+static char LORA_CMD_GET_SNR[]      = "radio get snr";
+
+static void _link_clear(void)
+{
+    _status.samples     = 0;
+    _status.margin_min  = 0;
+    _window_pos         = 0;
+    _window_dr          = _status.dr;
+}
+
+static void _link_add( int16_t margin )
+{
+    _window[ _window_pos ] = margin;
+    _window_pos = ( uint8_t )( ( _window_pos + 1 ) % LORA_LINK_WINDOW );
+
+    if( _status.samples < LORA_LINK_WINDOW )
+        _status.samples++;
+
+    _status.margin_min = _window[ 0 ];
+
+    for( uint8_t i = 1; i < _status.samples; i++ )
+    {
+        if( _window[ i ] < _status.margin_min )
+            _status.margin_min = _window[ i ];
+    }
+}
+
+/*
+ * The airtime layer goes back to the rate in use. */
+static void _link_dr_revert(void)
+{
+    _target_dr = _status.dr;
+    lora_airtime_set_dr( _status.dr );
+}
+
+static void _link_dr_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    lora_link_status_t status;
+
+    if( result )
+    {
+        LORA_LOG_WARN("[WARN] LoRa data rate DR%u not set: %u\n", _target_dr, result);
+        _link_dr_revert();
+        return;
+    }
+
+    LORA_LOG_INFO("[INFO] LoRa data rate DR%u -> DR%u, margin %d dB\n", _status.dr, _target_dr,
+                  _status.margin_last);
+
+    _stale_f        = true;
+    _stale_margin   = _status.margin_last;
+    _status.dr      = _target_dr;
+    _status.changes++;
+
+    lora_airtime_set_dr( _target_dr );
+    _link_clear();
+
+    status = _status;
+
+    if( _cb )
+        _cb( &status, _context );
+}
+
+/*
+ * A lower rate is given to the airtime layer at once: frames sized while
+ * the command is in flight then fit both rates. */
+static void _link_set_dr( uint8_t dr )
+{
+    _target_dr  = dr;
+    _retry_dr   = LORA_LINK_DR_NONE;
+    snprintf( _dr_cmd, sizeof( _dr_cmd ), "mac set dr %u", dr );
+
+    if( dr < _status.dr )
+        lora_airtime_set_dr( dr );
+
+    if( lora_cmd_async( _lora, _dr_cmd, _link_dr_cb, NULL ) )
+        return;
+
+    LORA_LOG_DEBUG("[DEBUG] LoRa data rate DR%u deferred, radio busy\n", dr);
+    _link_dr_revert();
+    _retry_dr = dr;
+}
+
+/*
+ * Lowest rate every queued frame still fits. They were sized for the rate
+ * in use, and the module refuses a frame too long for its rate. */
+static uint8_t _link_floor(void)
+{
+    size_t len = lora_uplink_largest();
+    uint8_t dr = LORA_LINK_DR_MIN;
+
+    if( lora_batch_pending() > len )
+        len = lora_batch_pending();
+
+    while( dr < _status.dr && lora_airtime_max_payload( dr ) < len )
+        dr++;
+
+    return dr;
+}
+
+/*
+ * Returns false when already at the lowest rate, or held by queued frames:
+ * the step is tried again after the next uplink. */
+static bool _link_step_down(void)
+{
+    uint8_t floor = _link_floor();
+
+    if( _status.dr <= floor )
+    {
+        if( floor > LORA_LINK_DR_MIN )
+            LORA_LOG_DEBUG("[DEBUG] LoRa data rate held at DR%u by queued frames\n", _status.dr);
+        return false;
+    }
+
+    _link_set_dr( ( uint8_t )( _status.dr - 1 ) );
+    return true;
+}
+
+/*
+ * Local ADR: a full window of margins above LORA_LINK_MARGIN_DB moves up
+ * one data rate per 2.5 dB in excess, the SNR step between spreading
+ * factors. One margin under LORA_LINK_MARGIN_LOW_DB moves down a rate. */
+static void _link_decide(void)
+{
+    int steps;
+
+    if( _status.margin_last < LORA_LINK_MARGIN_LOW_DB )
+    {
+        _link_step_down();
+        return;
+    }
+
+    if( _status.samples < LORA_LINK_WINDOW )
+        return;
+
+    steps = ( _status.margin_min - LORA_LINK_MARGIN_DB ) * 2 / 5;
+
+    if( steps <= 0 || _status.dr >= LORA_LINK_DR_MAX )
+        return;
+
+    _link_set_dr( ( uint8_t )( _status.dr + steps < LORA_LINK_DR_MAX ? _status.dr + steps : LORA_LINK_DR_MAX ) );
+}
+
+static void _link_sample_cb( lora_script_step_t *steps, size_t count, size_t failed, void *context )
+{
+    size_t i = 0;
+    int16_t margin;
+
+    if( !_armed_f )
+        _armed_f = steps[ i++ ].result == LORA_OK;
+
+    /* No gateway yet: the module has not had a LinkCheckAns */
+    if( steps[ i ].result || steps[ i + 1 ].result || atoi( steps[ i + 1 ].response ) == 0 )
+        return;
+
+    margin              = ( int16_t )atoi( steps[ i ].response );
+    _status.gateways    = ( uint8_t )atoi( steps[ i + 1 ].response );
+    i += 2;
+
+    /* A LinkCheckAns rides a downlink the module does not report: a new
+     * margin is the only sign of it. An unchanged one may be the old answer */
+    if( margin != _last_read )
+        _status.silent = 0;
+
+    _last_read = margin;
+
+    if( i < count && steps[ i ].result == LORA_OK )
+        _status.snr = ( int8_t )atoi( steps[ i ].response );
+
+    if( _stale_f && margin == _stale_margin )
+        return;
+
+    _stale_f            = false;
+    _status.margin_last = margin;
+    _link_add( margin );
+    _link_decide();
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa LINK INIT
+*******************************************************************************/
+void lora_link_init( lora_ctx_t *lora, lora_link_cb cb, void *context )
+{
+    _lora       = lora;
+    _cb         = cb;
+    _context    = context;
+
+    memset( &_status, 0, sizeof( _status ) );
+    lora_link_restart();
+}
+/******************************************************************************
+*  LoRa LINK RESTART
+*******************************************************************************/
+void lora_link_restart()
+{
+    _status.dr      = lora_airtime_dr();
+    _status.silent  = 0;
+    _armed_f        = false;
+    _stale_f        = false;
+    _last_read      = -1;
+    _target_dr      = _status.dr;
+    _retry_dr       = LORA_LINK_DR_NONE;
+
+    _link_clear();
+}
+/******************************************************************************
+*  LoRa LINK UPLINK
+*******************************************************************************/
+void lora_link_uplink( uint8_t result, bool confirmed )
+{
+    size_t count = 0;
+    uint8_t retry = _retry_dr;
+    bool heard = result == LORA_MAC_RX || ( confirmed && result == LORA_OK );
+
+    if( _lora == NULL )
+        return;
+
+    /* Set elsewhere ( join, session restore ): margins of the old rate are void */
+    if( lora_airtime_dr() != _window_dr )
+    {
+        _status.dr = lora_airtime_dr();
+        _link_clear();
+    }
+
+    _status.silent = heard ? 0 : _status.silent + 1;
+
+    /* A change the busy engine did not take, checked again against the queue */
+    if( retry != LORA_LINK_DR_NONE )
+    {
+        _retry_dr = LORA_LINK_DR_NONE;
+
+        if( retry > _status.dr || retry >= _link_floor() )
+        {
+            _link_set_dr( retry );
+            return;
+        }
+    }
+
+    /* Lost: a confirmed uplink went unanswered, or nothing came back for long */
+    if( ( ( confirmed && result == LORA_ERR_MAC ) || _status.silent >= LORA_LINK_SILENT_LIMIT ) &&
+        _link_step_down() )
+    {
+        _status.silent = 0;
+        return;
+    }
+
+    if( result != LORA_OK && result != LORA_MAC_RX )
+        return;
+
+    if( !_armed_f )
+    {
+        snprintf( _linkchk_cmd, sizeof( _linkchk_cmd ), "mac set linkchk %u", LORA_LINK_CHECK_INTERVAL_S );
+        _steps[ count++ ] = ( lora_script_step_t ){ .cmd = _linkchk_cmd };
+    }
+
+    _steps[ count++ ] = ( lora_script_step_t ){ .cmd = LORA_CMD_GET_MRGN };
+    _steps[ count++ ] = ( lora_script_step_t ){ .cmd = LORA_CMD_GET_GWNB };
+
+    if( heard )
+        _steps[ count++ ] = ( lora_script_step_t ){ .cmd = LORA_CMD_GET_SNR };
+
+    lora_script_async( _lora, _steps, count, _link_sample_cb, NULL );
+}
+/******************************************************************************
+*  LoRa LINK STATUS
+*******************************************************************************/
+void lora_link_status( lora_link_status_t *status )
+{
+    *status = _status;
+}
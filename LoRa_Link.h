@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LoRa.h"
+
+/**
+ * Link Check Interval ( s ): the module adds a LinkCheckReq to an uplink this often */
+#define LORA_LINK_CHECK_INTERVAL_S 60
+
+/**
+ * Margins a data rate decision is based on, the smallest of them counts */
+#define LORA_LINK_WINDOW 8
+
+/**
+ * Margin ( dB ) kept above the demodulation floor, as network ADR does */
+#define LORA_LINK_MARGIN_DB 10
+
+/**
+ * Margin ( dB ) under which the data rate steps down at once */
+#define LORA_LINK_MARGIN_LOW_DB 3
+
+/**
+ * Uplinks without anything heard from the network before the data rate steps down */
+#define LORA_LINK_SILENT_LIMIT 32
+
+/**
+ * Data Rates of the policy, EU868 125 kHz LoRa: SF12 to SF7 */
+#define LORA_LINK_DR_MIN 0
+#define LORA_LINK_DR_MAX 5
+
+/**
+ * @brief Link status
+ *
+ * The margin is what the network reports in its LinkCheckAns: how far
+ * above the demodulation floor of the data rate in use the best gateway
+ * received the uplink. The SNR is that of the last downlink, as the
+ * module received it.
+ */
+typedef struct {
+    uint8_t     dr;             /* data rate in use                        */
+    uint8_t     samples;        /* margins in the window                   */
+    int16_t     margin_min;     /* dB, smallest in the window              */
+    int16_t     margin_last;    /* dB                                      */
+    uint8_t     gateways;       /* gateways that heard the last link check */
+    int8_t      snr;            /* dB, last downlink                       */
+    uint32_t    silent;         /* uplinks since the network was heard     */
+    uint32_t    changes;        /* data rate changes since init            */
+} lora_link_status_t;
+
+/**
+ * @brief Data rate change callback
+ */
+typedef void (*lora_link_cb)( const lora_link_status_t *status, void *context );
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa LINK INIT
+*******************************************************************************/
+void lora_link_init( lora_ctx_t *lora, lora_link_cb cb, void *context );
+/******************************************************************************
+*  LoRa LINK RESTART
+*******************************************************************************/
+void lora_link_restart(void);
+/******************************************************************************
+*  LoRa LINK UPLINK
+*******************************************************************************/
+void lora_link_uplink( uint8_t result, bool confirmed );
+/******************************************************************************
+*  LoRa LINK STATUS
+*******************************************************************************/
+void lora_link_status( lora_link_status_t *status );
@@ -0,0 +1,86 @@
+#include "LoRa_Log.h"
+
+#include <time.h>
+
+#if LORA_TRACE_SIZE & ( LORA_TRACE_SIZE - 1 )
+#error "LORA_TRACE_SIZE must be a power of two"
+#endif
+
+#if LORA_TRACE_SIZE
+static lora_trace_entry_t   _trace[ LORA_TRACE_SIZE ];
+static uint32_t             _trace_next;    /* entries ever written */
+
+static const char *_trace_name( uint8_t event )
+{
+    switch( event & 0x0F )
+    {
+    case LORA_TRACE_CMD:            return "cmd";
+    case LORA_TRACE_RSP:            return "rsp";
+    case LORA_TRACE_STALE:          return "stale";
+    case LORA_TRACE_ABORT:          return "abort";
+    case LORA_TRACE_LINE_OVERFLOW:  return "overflow";
+    case LORA_TRACE_DOWNLINK:       return "downlink";
+    case LORA_TRACE_REJECT:         return "reject";
+    default:                        return "?";
+    }
+}
+#endif
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa TRACE
+*******************************************************************************/
+void lora_trace( uint8_t event, uint8_t a, uint16_t b )
+{
+#if LORA_TRACE_SIZE
+    lora_trace_entry_t *entry = &_trace[ _trace_next++ & ( LORA_TRACE_SIZE - 1 ) ];
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    entry->ms       = ( uint32_t )( ( uint64_t )now.tv_sec * 1000u + ( uint64_t )now.tv_nsec / 1000000u );
+    entry->event    = event;
+    entry->a        = a;
+    entry->b        = b;
+#endif
+}
+/******************************************************************************
+*  LoRa TRACE SNAPSHOT
+*******************************************************************************/
+size_t lora_trace_snapshot( lora_trace_entry_t *entries, size_t max )
+{
+#if LORA_TRACE_SIZE
+    uint32_t count = _trace_next < LORA_TRACE_SIZE ? _trace_next : LORA_TRACE_SIZE;
+    uint32_t first;
+
+    if( count > max )
+        count = ( uint32_t )max;
+
+    /* Oldest first, the newest count entries */
+    first = _trace_next - count;
+
+    for( uint32_t i = 0; i < count; i++ )
+        entries[ i ] = _trace[ ( first + i ) & ( LORA_TRACE_SIZE - 1 ) ];
+
+    return count;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Formats the ring on demand, whatever the log level: the only place
+ * trace entries cost a printf. */
+void lora_trace_dump()
+{
+#if LORA_TRACE_SIZE
+    lora_trace_entry_t entries[ LORA_TRACE_SIZE ];
+    size_t count = lora_trace_snapshot( entries, LORA_TRACE_SIZE );
+
+    Log_Debug("LoRa trace, %zu entries:\n", count);
+
+    for( size_t i = 0; i < count; i++ )
+        Log_Debug("  %10u #%u %-8s %3u %5u\n", entries[ i ].ms, entries[ i ].event >> 4,
+                  _trace_name( entries[ i ].event ), entries[ i ].a, entries[ i ].b);
+#endif
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/log.h>
+
+/**
+ * Log Levels: a message is compiled in when its level is at most
+ * LORA_LOG_LEVEL, set by the LORA_LOG_LEVEL CMake option */
+#define LORA_LOG_LEVEL_NONE     0
+#define LORA_LOG_LEVEL_ERROR    1
+#define LORA_LOG_LEVEL_WARN     2
+#define LORA_LOG_LEVEL_INFO     3
+#define LORA_LOG_LEVEL_DEBUG    4
+
+#ifndef LORA_LOG_LEVEL
+#define LORA_LOG_LEVEL LORA_LOG_LEVEL_DEBUG
+#endif
+
+/*
+ * Disabled levels keep their arguments type checked but generate no code:
+ * no format string, no call. */
+#define LORA_LOG_AT( level, ... ) \
+    do { if( ( level ) <= LORA_LOG_LEVEL ) Log_Debug( __VA_ARGS__ ); } while( 0 )
+
+#define LORA_LOG_ERROR( ... )   LORA_LOG_AT( LORA_LOG_LEVEL_ERROR, __VA_ARGS__ )
+#define LORA_LOG_WARN( ... )    LORA_LOG_AT( LORA_LOG_LEVEL_WARN, __VA_ARGS__ )
+#define LORA_LOG_INFO( ... )    LORA_LOG_AT( LORA_LOG_LEVEL_INFO, __VA_ARGS__ )
+#define LORA_LOG_DEBUG( ... )   LORA_LOG_AT( LORA_LOG_LEVEL_DEBUG, __VA_ARGS__ )
+
+/**
+ * Trace Ring Entries, a power of two; 0 compiles tracing out */
+#ifndef LORA_TRACE_SIZE
+#define LORA_TRACE_SIZE 64
+#endif
+
+/**
+ * @brief Trace events, with the meaning of their two arguments
+ */
+typedef enum {
+    LORA_TRACE_CMD = 1,         /* command kind, length                    */
+    LORA_TRACE_RSP,             /* response type, result code              */
+    LORA_TRACE_STALE,           /* response type, engine phase             */
+    LORA_TRACE_ABORT,           /* result code, engine phase               */
+    LORA_TRACE_LINE_OVERFLOW,   /* -, line length                          */
+    LORA_TRACE_DOWNLINK,        /* FPort, payload length                   */
+    LORA_TRACE_REJECT           /* -, length of the rejected request       */
+} lora_trace_event_t;
+
+/**
+ * @brief Trace entry, 8 bytes
+ */
+typedef struct {
+    uint32_t    ms;             /* CLOCK_MONOTONIC, wraps after 49 days    */
+    uint8_t     event;          /* lora_trace_event_t, driver instance in
+                                   the high nibble                         */
+    uint8_t     a;
+    uint16_t    b;
+} lora_trace_entry_t;
+
+#if LORA_TRACE_SIZE
+#define LORA_TRACE( event, a, b ) lora_trace( ( event ), ( uint8_t )( a ), ( uint16_t )( b ) )
+#else
+#define LORA_TRACE( event, a, b ) do { } while( 0 )
+#endif
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa TRACE
+*******************************************************************************/
+void lora_trace( uint8_t event, uint8_t a, uint16_t b );
+/******************************************************************************
+*  LoRa TRACE SNAPSHOT
+*******************************************************************************/
+size_t lora_trace_snapshot( lora_trace_entry_t *entries, size_t max );
+void lora_trace_dump(void);
@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "LoRa_Ring.h"
+
+#define LORA_RING_MASK ( LORA_RING_SIZE - 1 )
+
+_Static_assert( ( LORA_RING_SIZE & LORA_RING_MASK ) == 0, "LORA_RING_SIZE must be a power of two" );
+
+static void _ring_track( lora_ring_t *ring, uint32_t used )
+{
+    if( used > atomic_load_explicit( &ring->high_water, memory_order_relaxed ) )
+        atomic_store_explicit( &ring->high_water, used, memory_order_relaxed );
+}
+
+void lora_ring_init(lora_ring_t *ring)
+{
+    atomic_init( &ring->head, 0 );
+    atomic_init( &ring->tail, 0 );
+    atomic_init( &ring->overflows, 0 );
+    atomic_init( &ring->high_water, 0 );
+}
+
+size_t lora_ring_push(lora_ring_t *ring, const uint8_t *data, size_t len)
+{
+    size_t done = 0;
+    uint8_t *span;
+    size_t room;
+
+    while( done < len && ( room = lora_ring_write_span( ring, &span ) ) > 0 )
+    {
+        if( room > len - done )
+            room = len - done;
+
+        memcpy( span, data + done, room );
+        lora_ring_commit( ring, room );
+        done += room;
+    }
+
+    if( done < len )
+        atomic_fetch_add_explicit( &ring->overflows, ( uint32_t )( len - done ),
+                                   memory_order_relaxed );
+
+    return done;
+}
+
+size_t lora_ring_write_span(lora_ring_t *ring, uint8_t **span)
+{
+    uint32_t head = atomic_load_explicit( &ring->head, memory_order_relaxed );
+    uint32_t tail = atomic_load_explicit( &ring->tail, memory_order_acquire );
+    uint32_t free = LORA_RING_SIZE - ( head - tail );
+    uint32_t to_end = LORA_RING_SIZE - ( head & LORA_RING_MASK );
+
+    *span = &ring->data[ head & LORA_RING_MASK ];
+
+    return free < to_end ? free : to_end;
+}
+
+void lora_ring_commit(lora_ring_t *ring, size_t len)
+{
+    uint32_t head = atomic_load_explicit( &ring->head, memory_order_relaxed ) + ( uint32_t )len;
+    uint32_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+
+    atomic_store_explicit( &ring->head, head, memory_order_release );
+    _ring_track( ring, head - tail );
+}
+
+size_t lora_ring_read_span(lora_ring_t *ring, uint8_t **span)
+{
+    uint32_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+    uint32_t head = atomic_load_explicit( &ring->head, memory_order_acquire );
+    uint32_t used = head - tail;
+    uint32_t to_end = LORA_RING_SIZE - ( tail & LORA_RING_MASK );
+
+    *span = &ring->data[ tail & LORA_RING_MASK ];
+
+    return used < to_end ? used : to_end;
+}
+
+void lora_ring_release(lora_ring_t *ring, size_t len)
+{
+    uint32_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+
+    atomic_store_explicit( &ring->tail, tail + ( uint32_t )len, memory_order_release );
+}
+
+size_t lora_ring_used(lora_ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit( &ring->tail, memory_order_acquire );
+    uint32_t head = atomic_load_explicit( &ring->head, memory_order_acquire );
+
+    return head - tail;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Ring Size ( bytes ), must be a power of two */
+#define LORA_RING_SIZE 1024
+
+/**
+ * @brief Single-producer / single-consumer byte ring
+ *
+ * head is only written by the producer and tail only by the consumer, so
+ * the two sides can run in different threads (or an fd callback and the
+ * parser) without a lock. Indexes run freely and are masked on access.
+ */
+typedef struct {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t overflows;     /* bytes dropped because the ring was full */
+    _Atomic uint32_t high_water;    /* highest occupancy seen by the producer  */
+    uint8_t          data[ LORA_RING_SIZE ];
+} lora_ring_t;
+
+/**
+ * @brief Resets indexes and counters. Not thread safe.
+ */
+void lora_ring_init(lora_ring_t *ring);
+
+/**
+ * @brief Producer: copies len bytes in, dropping (and counting) what does not fit
+ *
+ * @return number of bytes accepted
+ */
+size_t lora_ring_push(lora_ring_t *ring, const uint8_t *data, size_t len);
+
+/**
+ * @brief Producer: returns the largest contiguous free span
+ *
+ * Lets the producer read() straight into the ring. Publish the bytes
+ * with lora_ring_commit.
+ */
+size_t lora_ring_write_span(lora_ring_t *ring, uint8_t **span);
+
+/**
+ * @brief Producer: publishes len bytes written into the span
+ */
+void lora_ring_commit(lora_ring_t *ring, size_t len);
+
+/**
+ * @brief Consumer: returns the largest contiguous pending span
+ *
+ * The span stays valid until lora_ring_release.
+ */
+size_t lora_ring_read_span(lora_ring_t *ring, uint8_t **span);
+
+/**
+ * @brief Consumer: gives len bytes back to the producer
+ */
+void lora_ring_release(lora_ring_t *ring, size_t len);
+
+/**
+ * @brief Number of bytes pending
+ */
+size_t lora_ring_used(lora_ring_t *ring);
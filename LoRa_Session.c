@@ -0,0 +1,305 @@
+#include "LoRa_Session.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "LoRa_Airtime.h"
+#include "LoRa_Hal.h"
+#include "LoRa_Log.h"
+
+#define LORA_SESSION_MAGIC      0x4C525353u     /* "LRSS" */
+#define LORA_SESSION_VERSION    1
+
+/**
+ * @brief Stored session
+ *
+ * The session keys never leave the module: "mac save" keeps them in its
+ * EEPROM, "mac join abp" resumes them. What the module does not keep
+ * reliably across a reset is restored from here.
+ */
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+    char        devaddr[ 12 ];  /* 8 hex digits, identifies the session    */
+    uint32_t    upctr;          /* checkpoint, above every counter used    */
+    uint32_t    dnctr;
+    uint32_t    dr;
+    uint32_t    check;          /* FNV-1a of the fields above              */
+} lora_session_rec_t;
+
+static lora_ctx_t*          _lora;
+static lora_session_rec_t   _session;
+static bool                 _valid_f;
+static uint32_t             _next_upctr;
+
+/* Operation in progress */
+static bool                 _busy_f;
+static lora_session_cb      _cb;
+static void*                _context;
+static lora_script_step_t   _steps[ 5 ];
+static char                 _step_cmd[ 3 ][ 32 ];
+static char                 _join_mode[] = "abp";
+
+static char LORA_CMD_GET_DEVADDR[]  = "mac get devaddr";
+static char LORA_CMD_GET_UPCTR[]    = "mac get upctr";
+static char LORA_CMD_GET_DNCTR[]    = "mac get dnctr";
+static char LORA_CMD_GET_DR[]       = "mac get dr";
+static char LORA_CMD_SAVE[]         = "mac save";
+
+static uint32_t _session_check( const lora_session_rec_t *rec )
+{
+    const uint8_t *byte = ( const uint8_t* )rec;
+    uint32_t hash = 2166136261u;
+
+    for( size_t i = 0; i < offsetof( lora_session_rec_t, check ); i++ )
+        hash = ( hash ^ byte[ i ] ) * 16777619u;
+
+    return hash;
+}
+
+static bool _session_store(void)
+{
+    int fd = LoRa_hal_storageOpen();
+    ssize_t len;
+
+    if( fd == -1 )
+        return false;
+
+    _session.check = _session_check( &_session );
+    len = pwrite( fd, &_session, sizeof( _session ), 0 );
+    close( fd );
+
+    if( len != ( ssize_t )sizeof( _session ) )
+    {
+        LORA_LOG_ERROR("ERROR: Could not store LoRa session: %s (%d).\n", strerror(errno), errno);
+        return false;
+    }
+
+    return true;
+}
+
+static bool _session_load(void)
+{
+    int fd = LoRa_hal_storageOpen();
+    ssize_t len;
+
+    if( fd == -1 )
+        return false;
+
+    len = pread( fd, &_session, sizeof( _session ), 0 );
+    close( fd );
+
+    return len == ( ssize_t )sizeof( _session ) && _session.magic == LORA_SESSION_MAGIC &&
+           _session.version == LORA_SESSION_VERSION && _session.check == _session_check( &_session );
+}
+
+/*
+ * Moves the stored checkpoint LORA_SESSION_CHECKPOINT uplinks ahead. */
+static void _session_checkpoint(void)
+{
+    _session.upctr  = _next_upctr + LORA_SESSION_CHECKPOINT;
+    _session.dr     = lora_airtime_dr();
+    _session_store();
+}
+
+static void _session_frame( bool downlink, void *context )
+{
+    if( !_valid_f )
+        return;
+
+    _next_upctr++;
+
+    if( downlink )
+        _session.dnctr++;
+
+    if( _next_upctr >= _session.upctr )
+        _session_checkpoint();
+}
+
+static void _session_finish( uint8_t result )
+{
+    lora_session_cb cb = _cb;
+
+    _busy_f = false;
+    _cb     = NULL;
+
+    if( cb )
+        cb( result, _context );
+}
+
+/*
+ * Result of the first failed step of a script. */
+static uint8_t _session_script_result( lora_script_step_t *steps, size_t count )
+{
+    for( size_t i = 0; i < count; i++ )
+    {
+        if( steps[ i ].result )
+            return steps[ i ].result;
+    }
+
+    return LORA_OK;
+}
+
+static void _session_restore_join_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    if( rsp->type != LORA_RSP_ACCEPTED )
+    {
+        _session_finish( result ? result : LORA_ERR_DENIED );
+        return;
+    }
+
+    /* Counters up to the checkpoint may have been used before the restart */
+    _next_upctr = _session.upctr;
+    lora_airtime_set_dr( ( uint8_t )_session.dr );
+    _session_checkpoint();
+
+    LORA_LOG_INFO("[INFO] LoRa session %s restored, upctr %u\n", _session.devaddr, _next_upctr);
+    _session_finish( LORA_OK );
+}
+
+static void _session_restore_script_cb( lora_script_step_t *steps, size_t count, size_t failed,
+                                        void *context )
+{
+    if( failed )
+    {
+        _session_finish( _session_script_result( steps, count ) );
+        return;
+    }
+
+    if( !lora_join_async( _lora, _join_mode, _session_restore_join_cb, NULL ) )
+        _session_finish( LORA_ERR_BUSY );
+}
+
+/*
+ * The module must still hold the session that was stored. */
+static void _session_restore_devaddr_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    if( result || strcmp( rsp->line, _session.devaddr ) != 0 )
+    {
+        LORA_LOG_WARN("[WARN] LoRa session %s not held by the module\n", _session.devaddr);
+        _session_finish( result ? result : LORA_ERR_KEYS_NOT_INIT );
+        return;
+    }
+
+    snprintf( _step_cmd[ 0 ], sizeof( _step_cmd[ 0 ] ), "mac set upctr %u", _session.upctr );
+    snprintf( _step_cmd[ 1 ], sizeof( _step_cmd[ 1 ] ), "mac set dnctr %u", _session.dnctr );
+    snprintf( _step_cmd[ 2 ], sizeof( _step_cmd[ 2 ] ), "mac set dr %u", _session.dr );
+
+    for( size_t i = 0; i < 3; i++ )
+        _steps[ i ] = ( lora_script_step_t ){ .cmd = _step_cmd[ i ] };
+
+    if( !lora_script_async( _lora, _steps, 3, _session_restore_script_cb, NULL ) )
+        _session_finish( LORA_ERR_BUSY );
+}
+
+static void _session_capture_cb( lora_script_step_t *steps, size_t count, size_t failed,
+                                 void *context )
+{
+    if( failed )
+    {
+        _session_finish( _session_script_result( steps, count ) );
+        return;
+    }
+
+    if( strlen( steps[ 0 ].response ) != 8 )
+    {
+        _session_finish( LORA_ERR_INVALID_PARAM );
+        return;
+    }
+
+    memset( &_session, 0, sizeof( _session ) );
+    _session.magic      = LORA_SESSION_MAGIC;
+    _session.version    = LORA_SESSION_VERSION;
+    memcpy( _session.devaddr, steps[ 0 ].response, 8 );
+    _session.dnctr      = ( uint32_t )strtoul( steps[ 2 ].response, NULL, 10 );
+
+    _next_upctr = ( uint32_t )strtoul( steps[ 1 ].response, NULL, 10 );
+    _valid_f    = true;
+
+    lora_airtime_set_dr( ( uint8_t )strtoul( steps[ 3 ].response, NULL, 10 ) );
+    _session_checkpoint();
+
+    LORA_LOG_INFO("[INFO] LoRa session %s stored, upctr %u\n", _session.devaddr, _next_upctr);
+    _session_finish( LORA_OK );
+}
+
+static bool _session_begin( lora_session_cb cb, void *context )
+{
+    if( _busy_f || lora_busy( _lora ) )
+        return false;
+
+    _busy_f     = true;
+    _cb         = cb;
+    _context    = context;
+    return true;
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa SESSION INIT
+*******************************************************************************/
+bool lora_session_init( lora_ctx_t *lora )
+{
+    _lora       = lora;
+    _valid_f    = _session_load();
+    _busy_f     = false;
+
+    lora_set_frame_cb( _lora, _session_frame, NULL );
+
+    return _valid_f;
+}
+/******************************************************************************
+*  LoRa SESSION RESTORE
+*******************************************************************************/
+bool lora_session_restore_async( lora_session_cb cb, void *context )
+{
+    if( !_valid_f || !_session_begin( cb, context ) )
+        return false;
+
+    if( !lora_cmd_async( _lora, LORA_CMD_GET_DEVADDR, _session_restore_devaddr_cb, NULL ) )
+    {
+        _busy_f = false;
+        return false;
+    }
+
+    return true;
+}
+/******************************************************************************
+*  LoRa SESSION CAPTURE
+*******************************************************************************/
+bool lora_session_capture_async( lora_session_cb cb, void *context )
+{
+    if( !_session_begin( cb, context ) )
+        return false;
+
+    /* mac save also writes the session keys derived by the join to the module */
+    _steps[ 0 ] = ( lora_script_step_t ){ .cmd = LORA_CMD_GET_DEVADDR };
+    _steps[ 1 ] = ( lora_script_step_t ){ .cmd = LORA_CMD_GET_UPCTR };
+    _steps[ 2 ] = ( lora_script_step_t ){ .cmd = LORA_CMD_GET_DNCTR };
+    _steps[ 3 ] = ( lora_script_step_t ){ .cmd = LORA_CMD_GET_DR };
+    _steps[ 4 ] = ( lora_script_step_t ){ .cmd = LORA_CMD_SAVE };
+
+    if( !lora_script_async( _lora, _steps, 5, _session_capture_cb, NULL ) )
+    {
+        _busy_f = false;
+        return false;
+    }
+
+    return true;
+}
+/******************************************************************************
+*  LoRa SESSION CLEAR
+*******************************************************************************/
+void lora_session_clear()
+{
+    if( !_valid_f )
+        return;
+
+    _valid_f = false;
+    memset( &_session, 0, sizeof( _session ) );
+    _session_store();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LoRa.h"
+
+/**
+ * Uplinks between two frame counter checkpoints: the stored counter runs
+ * this far ahead of the module, so a restart never reuses a counter */
+#define LORA_SESSION_CHECKPOINT 16
+
+/**
+ * @brief Session operation completion callback
+ *
+ * @param[in] result   LORA_OK, or the result code of the failed command
+ * @param[in] context  user pointer given at submission
+ */
+typedef void (*lora_session_cb)( uint8_t result, void *context );
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa SESSION INIT
+*******************************************************************************/
+bool lora_session_init( lora_ctx_t *lora );
+/******************************************************************************
+*  LoRa SESSION RESTORE
+*******************************************************************************/
+bool lora_session_restore_async( lora_session_cb cb, void *context );
+/******************************************************************************
+*  LoRa SESSION CAPTURE
+*******************************************************************************/
+bool lora_session_capture_async( lora_session_cb cb, void *context );
+/******************************************************************************
+*  LoRa SESSION CLEAR
+*******************************************************************************/
+void lora_session_clear(void);
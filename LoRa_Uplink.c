@@ -0,0 +1,359 @@
+#include "LoRa_Uplink.h"
+
+#include <string.h>
+
+#include "eventloop_timer_utilities.h"
+#include "LoRa_Airtime.h"
+#include "LoRa_Link.h"
+#include "LoRa_Log.h"
+
+/**
+ * @brief Queued message
+ */
+typedef struct {
+    bool        used;
+    uint8_t     port;
+    uint8_t     prio;
+    uint8_t     flags;
+    uint8_t     attempts;
+    uint8_t     len;
+    uint32_t    seq;                            /* submission order, FIFO within a priority */
+    uint8_t     data[ LORA_MAX_PAYLOAD_SIZE ];
+} lora_uplink_slot_t;
+
+static lora_ctx_t*          _lora;
+static lora_uplink_slot_t   _slots[ LORA_UPLINK_QUEUE_SIZE ];
+static lora_uplink_slot_t*  _inflight;
+static uint32_t             _seq;
+
+/* Dispatch gates */
+static bool                 _enabled_f;
+static bool                 _hold_f;
+static EventLoopTimer*      _hold_timer;
+
+static lora_uplink_cb       _cb;
+static void*                _context;
+static lora_uplink_stats_t  _stats;
+
+/*
+ * Highest priority queued message, oldest first. */
+static lora_uplink_slot_t *_uplink_next(void)
+{
+    lora_uplink_slot_t *next = NULL;
+
+    for( size_t i = 0; i < LORA_UPLINK_QUEUE_SIZE; i++ )
+    {
+        lora_uplink_slot_t *slot = &_slots[ i ];
+
+        if( !slot->used || slot == _inflight )
+            continue;
+
+        if( !next || slot->prio < next->prio || ( slot->prio == next->prio && slot->seq < next->seq ) )
+            next = slot;
+    }
+
+    return next;
+}
+
+/*
+ * Queued reading of the port that a new one supersedes. */
+static lora_uplink_slot_t *_uplink_coalesce_target( uint8_t port )
+{
+    for( size_t i = 0; i < LORA_UPLINK_QUEUE_SIZE; i++ )
+    {
+        lora_uplink_slot_t *slot = &_slots[ i ];
+
+        if( slot->used && slot != _inflight && slot->port == port &&
+            ( slot->flags & LORA_UPLINK_COALESCE ) )
+            return slot;
+    }
+
+    return NULL;
+}
+
+static void _uplink_notify( const lora_uplink_slot_t *msg, uint8_t result, bool final )
+{
+    if( _cb )
+        _cb( msg->port, msg->data, msg->len, result, final, _context );
+}
+
+/*
+ * Frees the slot first, so the callback can submit into it: the callback
+ * sees a copy of the message. */
+static void _uplink_release( lora_uplink_slot_t *slot, uint8_t result )
+{
+    lora_uplink_slot_t msg = *slot;
+
+    slot->used = false;
+    _stats.pending--;
+
+    _uplink_notify( &msg, result, true );
+}
+
+/*
+ * Free slot, or else the oldest message of the lowest priority below prio,
+ * which the caller evicts. */
+static lora_uplink_slot_t *_uplink_alloc( uint8_t prio )
+{
+    lora_uplink_slot_t *victim = NULL;
+
+    for( size_t i = 0; i < LORA_UPLINK_QUEUE_SIZE; i++ )
+    {
+        lora_uplink_slot_t *slot = &_slots[ i ];
+
+        if( !slot->used )
+            return slot;
+
+        if( slot == _inflight || slot->prio <= prio )
+            continue;
+
+        if( !victim || slot->prio > victim->prio || ( slot->prio == victim->prio && slot->seq < victim->seq ) )
+            victim = slot;
+    }
+
+    return victim;
+}
+
+static void _uplink_sent_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context );
+
+/*
+ * Holds dispatch back for delay_ms, the timer pumps again. */
+static void _uplink_hold( uint32_t delay_ms )
+{
+    struct timespec delay = { .tv_sec = delay_ms / 1000, .tv_nsec = ( delay_ms % 1000 ) * 1000000 };
+
+    _hold_f = true;
+    SetEventLoopTimerOneShot( _hold_timer, &delay );
+}
+
+/*
+ * Hands the next message to the driver when nothing holds the queue back,
+ * at the earliest instant the duty cycle allows. */
+static void _uplink_pump(void)
+{
+    lora_uplink_slot_t *slot;
+    uint32_t wait;
+
+    if( !_enabled_f || _hold_f || _inflight || lora_busy( _lora ) || !( slot = _uplink_next() ) )
+        return;
+
+    if( ( wait = lora_airtime_wait_ms() ) > 0 )
+    {
+        _uplink_hold( wait );
+        return;
+    }
+
+    _inflight = slot;
+
+    if( !lora_mac_tx_bytes_async( _lora, slot->port, slot->data, slot->len,
+                                  slot->flags & LORA_UPLINK_CONFIRMED, _uplink_sent_cb, NULL ) )
+    {
+        _inflight = NULL;
+        return;
+    }
+
+    slot->attempts++;
+}
+
+static void _uplink_sent_cb( uint8_t result, const lora_rsp_view_t *rsp, void *context )
+{
+    lora_uplink_slot_t *slot = _inflight;
+
+    _inflight = NULL;
+
+    /* The frame went on air, whether or not it was acknowledged */
+    if( result == LORA_OK || result == LORA_MAC_RX || result == LORA_ERR_MAC )
+    {
+        lora_metrics_airtime( _lora, lora_airtime_charge( slot->len + LORA_AIRTIME_FRAME_OVERHEAD ) );
+        lora_link_uplink( result, slot->flags & LORA_UPLINK_CONFIRMED );
+    }
+
+    switch( result )
+    {
+    case LORA_OK:
+    case LORA_MAC_RX:
+        _stats.sent++;
+        _uplink_release( slot, result );
+        return;
+
+    /* The session is gone: hold everything until the application rejoins */
+    case LORA_ERR_NOT_JOINED:
+    case LORA_ERR_FRAME_COUNTER:
+    case LORA_ERR_KEYS_NOT_INIT:
+        slot->attempts--;
+        _enabled_f = false;
+        break;
+
+    /* Transient: the message is sent again after a delay */
+    case LORA_ERR_BUSY:
+    case LORA_ERR_NO_FREE_CH:
+    case LORA_ERR_MAC_PAUSED:
+    case LORA_ERR_SILENT:
+    case LORA_ERR_MAC:
+    case LORA_ERR_TIMEOUT:
+    case LORA_ERR_CANCELLED:
+    case LORA_ERR_IO:
+        if( slot->attempts >= LORA_UPLINK_MAX_ATTEMPTS )
+        {
+            _stats.dropped++;
+            _uplink_release( slot, result );
+            return;
+        }
+
+        _stats.retries++;
+        _uplink_hold( LORA_UPLINK_RETRY_MS );
+        break;
+
+    /* The module will never take it */
+    default:
+        LORA_LOG_WARN("[WARN] uplink on port %d refused by the module: %u\n", slot->port, result);
+        _stats.dropped++;
+        _uplink_release( slot, result );
+        return;
+    }
+
+    _uplink_notify( slot, result, false );
+}
+
+static void _uplink_hold_event( EventLoopTimer *timer )
+{
+    ConsumeEventLoopTimerEvent( timer );
+
+    _hold_f = false;
+    _uplink_pump();
+}
+
+static void _uplink_idle( void *context )
+{
+    _uplink_pump();
+}
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa UPLINK INIT
+*******************************************************************************/
+bool lora_uplink_init( lora_ctx_t *lora, EventLoop *event_loop, lora_uplink_cb cb, void *context )
+{
+    memset( _slots, 0, sizeof( _slots ) );
+    memset( &_stats, 0, sizeof( _stats ) );
+
+    _lora       = lora;
+    _inflight   = NULL;
+    _seq        = 0;
+    _enabled_f  = false;
+    _hold_f     = false;
+    _cb         = cb;
+    _context    = context;
+
+    _hold_timer = CreateEventLoopDisarmedTimer( event_loop, _uplink_hold_event );
+
+    if( _hold_timer == NULL )
+        return false;
+
+    /* Dispatch whenever the driver frees up, whoever used it */
+    lora_set_idle_cb( _lora, _uplink_idle, NULL );
+    return true;
+}
+/******************************************************************************
+*  LoRa UPLINK DEINIT
+*******************************************************************************/
+void lora_uplink_deinit()
+{
+    lora_set_idle_cb( _lora, NULL, NULL );
+
+    DisposeEventLoopTimer( _hold_timer );
+    _hold_timer = NULL;
+}
+/******************************************************************************
+*  LoRa UPLINK SUBMIT
+*******************************************************************************/
+bool lora_uplink_submit( uint8_t port, const uint8_t *data, size_t len, lora_uplink_prio_t prio,
+                         uint8_t flags )
+{
+    lora_uplink_slot_t *slot = NULL;
+    lora_uplink_slot_t evicted = { .used = false };
+    uint8_t dr = lora_airtime_dr();
+
+    /* Too large for the current rate, the module would refuse it. Once
+       queued, the link policy keeps the rate high enough for it */
+    if( len > lora_airtime_max_payload( dr ) )
+    {
+        LORA_LOG_DEBUG("[DEBUG] uplink of %zu bytes rejected at DR%u\n", len, dr);
+        _stats.dropped++;
+        return false;
+    }
+
+    /* A newer reading replaces the queued one in place, keeping its turn */
+    if( ( flags & LORA_UPLINK_COALESCE ) && ( slot = _uplink_coalesce_target( port ) ) )
+    {
+        _stats.coalesced++;
+
+        if( prio < slot->prio )
+            slot->prio = ( uint8_t )prio;
+    }
+    else if( ( slot = _uplink_alloc( ( uint8_t )prio ) ) )
+    {
+        if( slot->used )
+        {
+            LORA_LOG_WARN("[WARN] uplink queue full, message on port %d evicted\n", slot->port);
+            evicted = *slot;
+            _stats.dropped++;
+        }
+        else
+            _stats.pending++;
+
+        slot->used      = true;
+        slot->port      = port;
+        slot->prio      = ( uint8_t )prio;
+        slot->seq       = _seq++;
+    }
+    else
+    {
+        LORA_LOG_WARN("[WARN] uplink queue full, message on port %d rejected\n", port);
+        _stats.dropped++;
+        return false;
+    }
+
+    slot->flags     = flags;
+    slot->attempts  = 0;
+    slot->len       = ( uint8_t )len;
+    memcpy( slot->data, data, len );
+
+    if( evicted.used )
+        _uplink_notify( &evicted, LORA_ERR_CANCELLED, true );
+
+    _stats.queued++;
+    _uplink_pump();
+
+    return true;
+}
+/******************************************************************************
+*  LoRa UPLINK ENABLE
+*******************************************************************************/
+void lora_uplink_enable( bool enabled )
+{
+    _enabled_f = enabled;
+    _uplink_pump();
+}
+/******************************************************************************
+*  LoRa UPLINK LARGEST
+*******************************************************************************/
+size_t lora_uplink_largest()
+{
+    size_t len = 0;
+
+    for( size_t i = 0; i < LORA_UPLINK_QUEUE_SIZE; i++ )
+    {
+        if( _slots[ i ].used && _slots[ i ].len > len )
+            len = _slots[ i ].len;
+    }
+
+    return len;
+}
+/******************************************************************************
+*  LoRa UPLINK STATS
+*******************************************************************************/
+void lora_uplink_stats( lora_uplink_stats_t *stats )
+{
+    *stats = _stats;
+}
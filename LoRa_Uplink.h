@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+#include "LoRa.h"
+
+/**
+ * Queue Depth ( messages ), preallocated */
+#define LORA_UPLINK_QUEUE_SIZE 8
+
+/**
+ * Transmissions of one message before it is dropped */
+#define LORA_UPLINK_MAX_ATTEMPTS 5
+
+/**
+ * Retry Delay ( ms ) after busy / no_free_ch / timeout */
+#define LORA_UPLINK_RETRY_MS 10000
+
+/**
+ * @brief Message priority, lower values are sent first
+ */
+typedef enum {
+    LORA_UPLINK_PRIO_ALARM = 0,
+    LORA_UPLINK_PRIO_EVENT,
+    LORA_UPLINK_PRIO_TELEMETRY
+} lora_uplink_prio_t;
+
+/**
+ * Submission Flags */
+#define LORA_UPLINK_CONFIRMED   0x01    /* mac tx cnf                              */
+#define LORA_UPLINK_COALESCE    0x02    /* replaces a queued reading on the port   */
+
+/**
+ * @brief Outcome of one transmission
+ *
+ * @param[in] port     FPort of the message
+ * @param[in] data     payload of the message, valid only during the call
+ * @param[in] len      payload size
+ * @param[in] result   result code of the transmission, LORA_OK / LORA_MAC_RX when sent
+ * @param[in] final    false when the message stays queued for another attempt
+ * @param[in] context  user pointer given to lora_uplink_init
+ */
+typedef void (*lora_uplink_cb)( uint8_t port, const uint8_t *data, size_t len, uint8_t result,
+                                bool final, void *context );
+
+/**
+ * @brief Queue counters
+ */
+typedef struct {
+    uint32_t queued;        /* messages accepted                          */
+    uint32_t coalesced;     /* messages that replaced a queued reading    */
+    uint32_t sent;          /* messages acknowledged by the module        */
+    uint32_t retries;       /* transmissions repeated after an error      */
+    uint32_t dropped;       /* messages rejected, evicted or given up     */
+    uint32_t pending;       /* messages currently queued                  */
+} lora_uplink_stats_t;
+
+/* ----------------------------------------------------------- IMPLEMENTATION */
+/******************************************************************************
+*  LoRa UPLINK INIT
+*******************************************************************************/
+bool lora_uplink_init( lora_ctx_t *lora, EventLoop *event_loop, lora_uplink_cb cb, void *context );
+/******************************************************************************
+*  LoRa UPLINK DEINIT
+*******************************************************************************/
+void lora_uplink_deinit(void);
+/******************************************************************************
+*  LoRa UPLINK SUBMIT
+*
+*  Refuses a payload larger than the current data rate carries,
+*  lora_airtime_max_payload( lora_airtime_dr() ).
+*******************************************************************************/
+bool lora_uplink_submit( uint8_t port, const uint8_t *data, size_t len, lora_uplink_prio_t prio,
+                         uint8_t flags );
+/******************************************************************************
+*  LoRa UPLINK ENABLE
+*******************************************************************************/
+void lora_uplink_enable( bool enabled );
+/******************************************************************************
+*  LoRa UPLINK LARGEST
+*
+*  Payload size of the longest queued message, 0 when the queue is empty.
+*******************************************************************************/
+size_t lora_uplink_largest(void);
+/******************************************************************************
+*  LoRa UPLINK STATS
+*******************************************************************************/
+void lora_uplink_stats( lora_uplink_stats_t *stats );
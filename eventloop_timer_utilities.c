@@ -37,6 +37,7 @@ struct EventLoopTimer {
     EventLoopTimerHandler handler;
     int fd;
     EventRegistration *registration;
+    void *context;
 };
 
 // This satisfies the EventLoopIoCallback signature.
@@ -62,6 +63,7 @@ EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTime
 
     timer->eventLoop = eventLoop;
     timer->handler = handler;
+    timer->context = NULL;
 
     // Initialize to unused values in case have to clean up partially initialized object.
     timer->fd = -1;
@@ -136,4 +138,14 @@ int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay
 int DisarmEventLoopTimer(EventLoopTimer *timer)
 {
     return SetTimerPeriod(timer->fd, /* initial */ NULL, /* repeat */ NULL);
+}
+
+void SetEventLoopTimerContext(EventLoopTimer *timer, void *context)
+{
+    timer->context = context;
+}
+
+void *GetEventLoopTimerContext(EventLoopTimer *timer)
+{
+    return timer->context;
 }
\ No newline at end of file
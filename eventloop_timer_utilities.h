@@ -99,4 +99,19 @@ int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay
 /// information.</returns>
 /// <seealso cref="SetEventLoopTimerOneShot" />
 /// <seealso cref="SetEventLoopTimerPeriod" />
-int DisarmEventLoopTimer(EventLoopTimer *timer);
\ No newline at end of file
+int DisarmEventLoopTimer(EventLoopTimer *timer);
+
+/// <summary>
+/// Associate a pointer with a timer, for handlers shared by several objects.
+/// </summary>
+/// <param name="timer">Timer to which the pointer is attached.</param>
+/// <param name="context">Any pointer, NULL when the timer is created.</param>
+/// <seealso cref="GetEventLoopTimerContext" />
+void SetEventLoopTimerContext(EventLoopTimer *timer, void *context);
+
+/// <summary>
+/// Return the pointer associated with a timer.
+/// </summary>
+/// <param name="timer">Timer to query, typically the one passed to the handler.</param>
+/// <returns>The pointer given to <see cref="SetEventLoopTimerContext" />, or NULL.</returns>
+void *GetEventLoopTimerContext(EventLoopTimer *timer);
@@ -0,0 +1,198 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include <applibs/log.h>
+#include <applibs/eventloop.h>
+#include <applibs/gpio.h>
+
+#include "gpio_input_utilities.h"
+
+const GpioInputConfig GpioInputConfig_Button = {.activeValue = GPIO_Value_Low,
+                                                .idlePollMs = 50,
+                                                .burstPollMs = 2,
+                                                .debounceMs = 20,
+                                                .burstMaxMs = 500};
+
+struct GpioInput {
+    EventLoop *eventLoop;
+    GpioInputHandler handler;
+    void *context;
+    GpioInputConfig config;
+    int gpioFd;
+    int timerFd;
+    EventRegistration *registration;
+
+    // Debounced level, and the level being confirmed during a burst
+    GPIO_Value_Type stable;
+    GPIO_Value_Type candidate;
+    bool burst;
+    unsigned heldMs;
+    unsigned burstMs;
+};
+
+static int SetPollPeriod(GpioInput *input, unsigned periodMs)
+{
+    struct timespec period = {.tv_sec = periodMs / 1000,
+                              .tv_nsec = (long)(periodMs % 1000) * 1000 * 1000};
+    struct itimerspec newValue = {.it_value = period, .it_interval = period};
+
+    if (timerfd_settime(input->timerFd, /* flags */ 0, &newValue, /* old_value */ NULL) == -1) {
+        Log_Debug("ERROR: Could not set input poll period: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void EndBurst(GpioInput *input)
+{
+    input->burst = false;
+    if (SetPollPeriod(input, input->config.idlePollMs) == -1) {
+        input->handler(input, GpioInputEvent_Error, input->context);
+    }
+}
+
+// This satisfies the EventLoopIoCallback signature.
+static void PollCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
+{
+    GpioInput *input = (GpioInput *)context;
+    uint64_t expirations = 0;
+    GPIO_Value_Type value;
+
+    if (read(input->timerFd, &expirations, sizeof(expirations)) == -1) {
+        if (errno == EAGAIN) {
+            return;
+        }
+        Log_Debug("ERROR: Could not read input timerfd: %s (%d).\n", strerror(errno), errno);
+        input->handler(input, GpioInputEvent_Error, input->context);
+        return;
+    }
+
+    if (GPIO_GetValue(input->gpioFd, &value) != 0) {
+        Log_Debug("ERROR: Could not read input GPIO: %s (%d).\n", strerror(errno), errno);
+        input->handler(input, GpioInputEvent_Error, input->context);
+        return;
+    }
+
+    // At rest: nothing to do until the level moves, then sample fast to debounce it
+    if (!input->burst) {
+        if (value == input->stable) {
+            return;
+        }
+        input->burst = true;
+        input->candidate = value;
+        input->heldMs = 0;
+        input->burstMs = 0;
+        if (SetPollPeriod(input, input->config.burstPollMs) == -1) {
+            input->handler(input, GpioInputEvent_Error, input->context);
+        }
+        return;
+    }
+
+    unsigned elapsedMs = (unsigned)expirations * input->config.burstPollMs;
+    input->burstMs += elapsedMs;
+
+    if (value != input->candidate) {
+        input->candidate = value;
+        input->heldMs = 0;
+    } else {
+        input->heldMs += elapsedMs;
+    }
+
+    if (input->heldMs >= input->config.debounceMs) {
+        bool changed = input->candidate != input->stable;
+
+        input->stable = input->candidate;
+        EndBurst(input);
+
+        // The release is reported too, so the next press is seen as one
+        if (changed) {
+            input->handler(input,
+                           input->stable == input->config.activeValue ? GpioInputEvent_Pressed
+                                                                      : GpioInputEvent_Released,
+                           input->context);
+        }
+    } else if (input->burstMs >= input->config.burstMaxMs) {
+        Log_Debug("WARNING: Input GPIO did not settle in %u ms, ignored.\n", input->burstMs);
+        EndBurst(input);
+    }
+}
+
+GpioInput *CreateGpioInput(EventLoop *eventLoop, int gpioFd, const GpioInputConfig *config,
+                           GpioInputHandler handler, void *context)
+{
+    if (handler == NULL || gpioFd < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    GpioInput *input = calloc(1, sizeof(GpioInput));
+    if (input == NULL) {
+        return NULL;
+    }
+
+    input->eventLoop = eventLoop;
+    input->handler = handler;
+    input->context = context;
+    input->config = config ? *config : GpioInputConfig_Button;
+    input->gpioFd = gpioFd;
+
+    // Initialize to unused values in case have to clean up partially initialized object.
+    input->timerFd = -1;
+    input->registration = NULL;
+
+    if (GPIO_GetValue(gpioFd, &input->stable) != 0) {
+        Log_Debug("ERROR: Could not read input GPIO: %s (%d).\n", strerror(errno), errno);
+        goto failed;
+    }
+
+    input->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (input->timerFd == -1) {
+        Log_Debug("ERROR: Unable to create input timer: %s (%d).\n", strerror(errno), errno);
+        goto failed;
+    }
+
+    if (SetPollPeriod(input, input->config.idlePollMs) == -1) {
+        goto failed;
+    }
+
+    input->registration =
+        EventLoop_RegisterIo(eventLoop, input->timerFd, EventLoop_Input, PollCallback, input);
+    if (input->registration == NULL) {
+        Log_Debug("ERROR: Unable to register input event: %s (%d).\n", strerror(errno), errno);
+        goto failed;
+    }
+
+    return input;
+
+failed:
+    DisposeGpioInput(input);
+    return NULL;
+}
+
+void DisposeGpioInput(GpioInput *input)
+{
+    if (input == NULL) {
+        return;
+    }
+
+    if (input->registration != NULL) {
+        EventLoop_UnregisterIo(input->eventLoop, input->registration);
+    }
+
+    if (input->timerFd != -1) {
+        close(input->timerFd);
+    }
+
+    free(input);
+}
+
+bool IsGpioInputActive(const GpioInput *input)
+{
+    return input->stable == input->config.activeValue;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdbool.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/gpio.h>
+
+/// <summary>
+/// Opaque handle. Obtain via <see cref="CreateGpioInput" /> and dispose of via
+/// <see cref="DisposeGpioInput" />.
+/// </summary>
+typedef struct GpioInput GpioInput;
+
+/// <summary>
+/// Debounced changes of a GPIO input. GpioInputEvent_Error reports a failure to
+/// read the GPIO or the poll timer, errno holds the cause.
+/// </summary>
+typedef enum {
+    GpioInputEvent_Pressed,
+    GpioInputEvent_Released,
+    GpioInputEvent_Error
+} GpioInputEvent;
+
+/// <summary>
+/// Applications implement a function with this signature to be notified when an
+/// input changes state.
+/// </summary>
+/// <param name="input">The input which changed.</param>
+/// <param name="event">What happened.</param>
+/// <param name="context">The context given to <see cref="CreateGpioInput" />.</param>
+typedef void (*GpioInputHandler)(GpioInput *input, GpioInputEvent event, void *context);
+
+/// <summary>
+/// Polling parameters. While the input is stable it is sampled every idlePollMs;
+/// a change switches to burstPollMs until the new level has held for debounceMs.
+/// A level that keeps bouncing for burstMaxMs is ignored.
+/// </summary>
+typedef struct {
+    GPIO_Value_Type activeValue;
+    unsigned idlePollMs;
+    unsigned burstPollMs;
+    unsigned debounceMs;
+    unsigned burstMaxMs;
+} GpioInputConfig;
+
+/// <summary>
+/// Defaults for a push button wired to ground: 20 samples per second at rest.
+/// </summary>
+extern const GpioInputConfig GpioInputConfig_Button;
+
+/// <summary>
+/// Start watching a GPIO input on the event loop. The current level is taken as
+/// the initial state and reports no event.
+/// </summary>
+/// <param name="eventLoop">Event loop to which the input will be added.</param>
+/// <param name="gpioFd">GPIO opened as input; it stays owned by the caller.</param>
+/// <param name="config">Polling parameters, NULL for <see cref="GpioInputConfig_Button" />.</param>
+/// <param name="handler">Callback to invoke when the input changes.</param>
+/// <param name="context">Passed to the handler.</param>
+/// <returns>On success, pointer to new GpioInput, which should be disposed of with
+/// <see cref="DisposeGpioInput" />. On failure, returns NULL, with more information
+/// available in errno.</returns>
+GpioInput *CreateGpioInput(EventLoop *eventLoop, int gpioFd, const GpioInputConfig *config,
+                           GpioInputHandler handler, void *context);
+
+/// <summary>
+/// Stop watching the input and free its resources.
+/// </summary>
+/// <param name="input">Input to dispose of. If NULL, this function does nothing.</param>
+void DisposeGpioInput(GpioInput *input);
+
+/// <summary>
+/// Debounced state of the input.
+/// </summary>
+/// <param name="input">Input to query.</param>
+/// <returns>true while the input is at its active level.</returns>
+bool IsGpioInputActive(const GpioInput *input);
@@ -0,0 +1,8 @@
+/* Host shim of the Azure Sphere applibs log API, see applibs_host.c */
+
+#pragma once
+
+/// <summary>
+///     Formats a debug message to stderr. Silenced when LORA_HOST_QUIET is set.
+/// </summary>
+int Log_Debug(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
@@ -0,0 +1,187 @@
+/* Linux implementation of the applibs subset used by the LoRa driver, so
+   the driver and its tools can be built and run off-device. */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <applibs/log.h>
+#include <applibs/eventloop.h>
+
+struct EventRegistration {
+    int fd;
+    EventLoopIoCallback *callback;
+    void *context;
+    EventRegistration *next;
+};
+
+struct EventLoop {
+    int epollFd;
+    bool stopped;
+    EventRegistration *registrations;
+};
+
+int Log_Debug(const char *fmt, ...)
+{
+    static int quiet = -1;
+    va_list args;
+    int result;
+
+    if (quiet < 0) {
+        quiet = getenv("LORA_HOST_QUIET") != NULL;
+    }
+
+    if (quiet) {
+        return 0;
+    }
+
+    va_start(args, fmt);
+    result = vfprintf(stderr, fmt, args);
+    va_end(args);
+
+    return result;
+}
+
+EventLoop *EventLoop_Create(void)
+{
+    EventLoop *el = calloc(1, sizeof(EventLoop));
+    if (el == NULL) {
+        return NULL;
+    }
+
+    el->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (el->epollFd == -1) {
+        free(el);
+        return NULL;
+    }
+
+    return el;
+}
+
+void EventLoop_Close(EventLoop *el)
+{
+    if (el == NULL) {
+        return;
+    }
+
+    while (el->registrations != NULL) {
+        EventRegistration *reg = el->registrations;
+        el->registrations = reg->next;
+        free(reg);
+    }
+
+    close(el->epollFd);
+    free(el);
+}
+
+static int64_t MonotonicMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int duration_in_milliseconds,
+                                   bool process_one_event)
+{
+    int64_t deadline = MonotonicMs() + duration_in_milliseconds;
+    bool processed = false;
+
+    el->stopped = false;
+
+    while (!el->stopped) {
+        int timeout = -1;
+        struct epoll_event event;
+
+        if (duration_in_milliseconds >= 0) {
+            int64_t left = deadline - MonotonicMs();
+            timeout = left > 0 ? (int)left : 0;
+        }
+
+        // One event per wait, so a callback may unregister any other fd
+        int n = epoll_wait(el->epollFd, &event, 1, timeout);
+        if (n < 0) {
+            return EventLoop_Run_Failed;
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        EventRegistration *reg = event.data.ptr;
+        reg->callback(el, reg->fd, event.events, reg->context);
+        processed = true;
+
+        if (process_one_event) {
+            break;
+        }
+    }
+
+    return processed ? EventLoop_Run_Finished : EventLoop_Run_FinishedEmpty;
+}
+
+int EventLoop_Stop(EventLoop *el)
+{
+    el->stopped = true;
+    return 0;
+}
+
+int EventLoop_GetWaitDescriptor(EventLoop *el)
+{
+    return el->epollFd;
+}
+
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd, EventLoop_IoEvents eventBitmask,
+                                        EventLoopIoCallback *callback, void *context)
+{
+    EventRegistration *reg = calloc(1, sizeof(EventRegistration));
+    if (reg == NULL) {
+        return NULL;
+    }
+
+    reg->fd = fd;
+    reg->callback = callback;
+    reg->context = context;
+
+    struct epoll_event event = {.events = eventBitmask, .data.ptr = reg};
+    if (epoll_ctl(el->epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        free(reg);
+        return NULL;
+    }
+
+    reg->next = el->registrations;
+    el->registrations = reg;
+
+    return reg;
+}
+
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg,
+                             EventLoop_IoEvents eventBitmask)
+{
+    struct epoll_event event = {.events = eventBitmask, .data.ptr = reg};
+    return epoll_ctl(el->epollFd, EPOLL_CTL_MOD, reg->fd, &event);
+}
+
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg)
+{
+    if (reg == NULL) {
+        return 0;
+    }
+
+    epoll_ctl(el->epollFd, EPOLL_CTL_DEL, reg->fd, NULL);
+
+    for (EventRegistration **link = &el->registrations; *link != NULL; link = &(*link)->next) {
+        if (*link == reg) {
+            *link = reg->next;
+            break;
+        }
+    }
+
+    free(reg);
+    return 0;
+}
@@ -0,0 +1,595 @@
+/* Latency and throughput benchmark of the LoRa command path.
+
+   Drives the driver against rn2483_sim (spawned, or an existing device
+   given with -P) and reports, per command type, p50/p99/max latency,
+   syscalls, UART bytes and bytes copied per command, and CPU time per
+   command. The driver's read/write/poll calls are counted through linker
+   wrapping (see CMakeLists.txt), so per-byte I/O creeping back in shows
+   up directly in the syscall columns. UART bytes are those read from and
+   written to the module fds only.
+
+   Bytes copied are the driver's bytes_copied metric: the command as it
+   is assembled, its copy into the transmit ring, the line assembler, the
+   response copy of the blocking calls and the downlink decode. Copies
+   made by the kernel in read and write are not included.
+
+   Each module is reset, and its boot banner awaited, before the first
+   timed command.
+
+   With -t the UART is owned by the radio I/O thread ( lora_attach_thread ):
+   the syscall column then counts both threads, eventfd signalling included.
+
+   With -m, that many simulated modules are driven from the one event loop
+   and tx_multi sends an unconfirmed uplink on each of them at once: its
+   latency is that of the whole round.
+
+   With -r, the health supervisor ( LoRa_Health.c ) watches the first
+   module and the simulator is made to fail before each sample: the
+   recover_pause and recover_stall latencies are those from the fault to
+   the next uplink that goes through, with 100 ms response timeouts.
+
+   With -g, the simulators model a link at that gateway SNR: tx_link sends
+   unconfirmed uplinks starting at DR0 while the link policy ( LoRa_Link.c )
+   picks the data rate, and the rate reached and time on air are reported.
+
+   usage: lora_bench [-n iterations] [-p payload_bytes] [-a sim_airtime_ms]
+                     [-m modules] [-s sim_path] [-P pty] [-t] [-r] [-g snr_db] [-j] */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <applibs/eventloop.h>
+
+#include "LoRa.h"
+#include "LoRa_Airtime.h"
+#include "LoRa_Health.h"
+#include "LoRa_Link.h"
+#include "LoRa_Session.h"
+
+#define BENCH_MAX_ITERATIONS 100000
+#define BENCH_MAX_MODULES 4
+#define BENCH_RECOVERY_TIMEOUT_MS 100
+#define BENCH_RECOVERY_MAX_TRIES 20
+
+// Linker-wrapped syscalls, counted while a sample is being measured, from both threads with -t
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+static struct {
+    _Atomic uint64_t syscalls;
+    _Atomic uint64_t bytesOut;
+    _Atomic uint64_t bytesIn;
+} io;
+
+// Module fds, set once the driver opened them: eventfds and pipes carry no UART bytes
+static int uartFd[BENCH_MAX_MODULES] = {-1, -1, -1, -1};
+
+static bool IsUart(int fd)
+{
+    for (size_t i = 0; i < BENCH_MAX_MODULES; i++) {
+        if (uartFd[i] == fd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+    ssize_t result = __real_read(fd, buf, count);
+    io.syscalls++;
+    if (result > 0 && IsUart(fd)) {
+        io.bytesIn += (uint64_t)result;
+    }
+    return result;
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+    ssize_t result = __real_write(fd, buf, count);
+    io.syscalls++;
+    if (result > 0 && IsUart(fd)) {
+        io.bytesOut += (uint64_t)result;
+    }
+    return result;
+}
+
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    io.syscalls++;
+    return __real_poll(fds, nfds, timeout);
+}
+
+typedef struct {
+    const char *name;
+    size_t count;
+    uint64_t latencyNs[BENCH_MAX_ITERATIONS];
+    uint64_t cpuNs;
+    uint64_t syscalls;
+    uint64_t bytesOut;
+    uint64_t bytesIn;
+    uint64_t copied;
+    size_t failures;
+} Series;
+
+static EventLoop *eventLoop;
+static lora_ctx_t lora[BENCH_MAX_MODULES];
+static size_t modules = 1;
+static bool asyncDone;
+static uint8_t asyncResult;
+static size_t multiPending;
+static uint8_t multiResult;
+static FILE *simControl;
+static bool sessionDone;
+
+static uint64_t Copied(void)
+{
+    uint64_t copied = 0;
+
+    for (size_t i = 0; i < modules; i++) {
+        copied += lora[i].metrics.bytes_copied;
+    }
+    return copied;
+}
+
+static uint64_t NowNs(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void AsyncCompleted(uint8_t result, const lora_rsp_view_t *rsp, void *context)
+{
+    asyncResult = result;
+    asyncDone = true;
+}
+
+typedef uint8_t (*BenchOp)(const uint8_t *payload, size_t len);
+
+static uint8_t OpCmd(const uint8_t *payload, size_t len)
+{
+    char response[64];
+    lora_cmd(&lora[0], "sys get ver", response);
+    return lora_banner(response) ? LORA_OK : LORA_ERR_INVALID_PARAM;
+}
+
+static uint8_t OpCmdAsync(const uint8_t *payload, size_t len)
+{
+    asyncDone = false;
+    if (!lora_cmd_async(&lora[0], "sys get ver", AsyncCompleted, NULL)) {
+        return LORA_ERR_BUSY;
+    }
+    while (!asyncDone) {
+        if (EventLoop_Run(eventLoop, -1, true) == EventLoop_Run_Failed && errno != EINTR) {
+            return LORA_ERR_BUSY;
+        }
+    }
+    return asyncResult;
+}
+
+static uint8_t OpJoin(const uint8_t *payload, size_t len)
+{
+    char response[64];
+    return lora_join(&lora[0], "otaa", response);
+}
+
+static uint8_t OpTxUncnf(const uint8_t *payload, size_t len)
+{
+    return lora_mac_tx_bytes(&lora[0], 1, payload, len, false);
+}
+
+static uint8_t OpTxCnf(const uint8_t *payload, size_t len)
+{
+    return lora_mac_tx_bytes(&lora[0], 1, payload, len, true);
+}
+
+static void MultiCompleted(uint8_t result, const lora_rsp_view_t *rsp, void *context)
+{
+    if (result != LORA_OK && result != LORA_MAC_RX) {
+        multiResult = result;
+    }
+    multiPending--;
+}
+
+static uint8_t OpTxMulti(const uint8_t *payload, size_t len)
+{
+    multiPending = 0;
+    multiResult = LORA_OK;
+
+    for (size_t i = 0; i < modules; i++) {
+        if (lora_mac_tx_bytes_async(&lora[i], 1, payload, len, false, MultiCompleted, NULL)) {
+            multiPending++;
+        } else {
+            multiResult = LORA_ERR_BUSY;
+        }
+    }
+    while (multiPending > 0) {
+        if (EventLoop_Run(eventLoop, -1, true) == EventLoop_Run_Failed && errno != EINTR) {
+            return LORA_ERR_BUSY;
+        }
+    }
+    return multiResult;
+}
+
+static void SessionCompleted(uint8_t result, void *context)
+{
+    sessionDone = true;
+}
+
+// Uplinks that go through: the supervisor counts the module stable again
+static uint8_t OpStabilize(const uint8_t *payload, size_t len)
+{
+    for (size_t i = 0; i < LORA_HEALTH_STABLE; i++) {
+        lora_mac_tx_bytes(&lora[0], 1, payload, len, false);
+    }
+    return LORA_OK;
+}
+
+// Uplinks until one goes through, the supervisor recovers the module meanwhile
+static uint8_t Recover(const char *fault, const uint8_t *payload, size_t len)
+{
+    uint8_t result = LORA_ERR_TIMEOUT;
+
+    fprintf(simControl, "inject %s\n", fault);
+    fflush(simControl);
+    usleep(1000);
+
+    for (size_t i = 0; i < BENCH_RECOVERY_MAX_TRIES && result != LORA_OK; i++) {
+        result = lora_mac_tx_bytes(&lora[0], 1, payload, len, false);
+    }
+    return result;
+}
+
+// What the uplink queue does after each frame: charge its airtime, feed the link policy
+static uint8_t OpTxLink(const uint8_t *payload, size_t len)
+{
+    uint8_t result = lora_mac_tx_bytes(&lora[0], 1, payload, len, false);
+
+    if (result == LORA_OK || result == LORA_MAC_RX) {
+        lora_metrics_airtime(&lora[0], lora_airtime_charge(len + LORA_AIRTIME_FRAME_OVERHEAD));
+    }
+    lora_link_uplink(result, false);
+    return result;
+}
+
+static uint8_t OpRecoverPause(const uint8_t *payload, size_t len)
+{
+    return Recover("pause", payload, len);
+}
+
+static uint8_t OpRecoverStall(const uint8_t *payload, size_t len)
+{
+    return Recover("stall", payload, len);
+}
+
+static void Run(Series *series, const char *name, BenchOp op, BenchOp setup, size_t iterations,
+                const uint8_t *payload, size_t len)
+{
+    series->name = name;
+    series->count = 0;
+
+    for (size_t i = 0; i < iterations; i++) {
+        if (setup != NULL) {
+            setup(payload, len);
+        }
+
+        uint64_t syscalls = io.syscalls, bytesOut = io.bytesOut, bytesIn = io.bytesIn;
+        uint64_t copied = Copied();
+        uint64_t cpu = NowNs(CLOCK_PROCESS_CPUTIME_ID);
+        uint64_t start = NowNs(CLOCK_MONOTONIC);
+
+        uint8_t result = op(payload, len);
+
+        series->latencyNs[series->count++] = NowNs(CLOCK_MONOTONIC) - start;
+        series->cpuNs += NowNs(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+        series->syscalls += io.syscalls - syscalls;
+        series->bytesOut += io.bytesOut - bytesOut;
+        series->bytesIn += io.bytesIn - bytesIn;
+        series->copied += Copied() - copied;
+
+        if (result != LORA_OK && result != LORA_MAC_RX) {
+            series->failures++;
+        }
+    }
+}
+
+static int CompareU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void Report(Series *series, size_t payloadLen, bool json)
+{
+    size_t n = series->count;
+
+    if (n == 0) {
+        return;
+    }
+
+    qsort(series->latencyNs, n, sizeof(uint64_t), CompareU64);
+
+    double p50 = series->latencyNs[(n - 1) * 50 / 100] / 1e3;
+    double p99 = series->latencyNs[(n - 1) * 99 / 100] / 1e3;
+    double max = series->latencyNs[n - 1] / 1e3;
+
+    if (json) {
+        printf("{\"command\":\"%s\",\"iterations\":%zu,\"payload_bytes\":%zu,\"failures\":%zu,"
+               "\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,\"cpu_us_per_cmd\":%.1f,"
+               "\"syscalls_per_cmd\":%.2f,\"uart_bytes_out_per_cmd\":%.1f,"
+               "\"uart_bytes_in_per_cmd\":%.1f,\"bytes_copied_per_cmd\":%.1f}\n",
+               series->name, n, payloadLen, series->failures, p50, p99, max,
+               series->cpuNs / 1e3 / n, (double)series->syscalls / n,
+               (double)series->bytesOut / n, (double)series->bytesIn / n,
+               (double)series->copied / n);
+    } else {
+        printf("%-13s %6zu %5zu %10.1f %10.1f %10.1f %10.1f %9.2f %8.1f %8.1f %8.1f\n", series->name,
+               n, series->failures, p50, p99, max, series->cpuNs / 1e3 / n,
+               (double)series->syscalls / n, (double)series->bytesOut / n,
+               (double)series->bytesIn / n, (double)series->copied / n);
+    }
+}
+
+static pid_t SpawnSimulator(const char *simPath, unsigned airtimeMs, const char *snr, char *pty,
+                            FILE **control)
+{
+    int out[2];
+    int in[2];
+    char airtime[16];
+
+    if (pipe(out) == -1 || pipe(in) == -1) {
+        return -1;
+    }
+
+    snprintf(airtime, sizeof(airtime), "%u", airtimeMs);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(out[1], STDOUT_FILENO);
+        dup2(in[0], STDIN_FILENO);
+        close(out[0]);
+        close(out[1]);
+        close(in[0]);
+        close(in[1]);
+        if (snr != NULL) {
+            execl(simPath, simPath, "-q", "-a", airtime, "-j", airtime, "-g", snr, (char *)NULL);
+        } else {
+            execl(simPath, simPath, "-q", "-a", airtime, "-j", airtime, (char *)NULL);
+        }
+        _exit(127);
+    }
+
+    close(out[1]);
+    close(in[0]);
+    *control = fdopen(in[1], "w");
+
+    FILE *stream = fdopen(out[0], "r");
+    char line[PATH_MAX + 8];
+
+    if (pid < 0 || stream == NULL || fgets(line, sizeof(line), stream) == NULL ||
+        sscanf(line, "PTY %s", pty) != 1) {
+        fprintf(stderr, "bench: could not start %s\n", simPath);
+        return -1;
+    }
+
+    return pid;
+}
+
+int main(int argc, char *argv[])
+{
+    static Series series[9];
+    char simPath[PATH_MAX];
+    char pty[BENCH_MAX_MODULES][PATH_MAX] = {""};
+    pid_t sim[BENCH_MAX_MODULES];
+    FILE *control[BENCH_MAX_MODULES] = {NULL};
+    char storage[] = "/tmp/lora_bench_storage.XXXXXX";
+    size_t iterations = 200;
+    size_t payloadLen = 11;
+    unsigned airtimeMs = 0;
+    bool json = false;
+    bool ioThread = false;
+    bool recovery = false;
+    const char *snr = NULL;
+    int opt;
+
+    // Default simulator: next to this executable
+    ssize_t selfLen = readlink("/proc/self/exe", simPath, sizeof(simPath) - 1);
+    simPath[selfLen > 0 ? selfLen : 0] = '\0';
+    char *slash = strrchr(simPath, '/');
+    snprintf(slash ? slash + 1 : simPath, sizeof(simPath) - (size_t)(slash ? slash + 1 - simPath : 0),
+             "rn2483_sim");
+
+    while ((opt = getopt(argc, argv, "n:p:a:m:s:P:trg:j")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = (size_t)atol(optarg);
+            break;
+        case 'p':
+            payloadLen = (size_t)atol(optarg);
+            break;
+        case 'a':
+            airtimeMs = (unsigned)atoi(optarg);
+            break;
+        case 'm':
+            modules = (size_t)atol(optarg);
+            break;
+        case 's':
+            snprintf(simPath, sizeof(simPath), "%s", optarg);
+            break;
+        case 'P':
+            snprintf(pty[0], sizeof(pty[0]), "%s", optarg);
+            break;
+        case 't':
+            ioThread = true;
+            break;
+        case 'r':
+            recovery = true;
+            break;
+        case 'g':
+            snr = optarg;
+            break;
+        case 'j':
+            json = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-p payload_bytes] [-a sim_airtime_ms] "
+                            "[-m modules] [-s sim_path] [-P pty] [-t] [-r] [-g snr_db] [-j]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (iterations > BENCH_MAX_ITERATIONS) {
+        iterations = BENCH_MAX_ITERATIONS;
+    }
+
+    if (payloadLen > LORA_MAX_PAYLOAD_SIZE) {
+        payloadLen = LORA_MAX_PAYLOAD_SIZE;
+    }
+
+    // A device given with -P is the only module
+    if (pty[0][0] != '\0' || modules < 1) {
+        modules = 1;
+    }
+    if (modules > BENCH_MAX_MODULES) {
+        modules = BENCH_MAX_MODULES;
+    }
+
+    for (size_t i = 0; i < modules; i++) {
+        sim[i] = -1;
+        if (pty[i][0] == '\0' && (sim[i] = SpawnSimulator(simPath, airtimeMs, snr, pty[i], &control[i])) < 0) {
+            return 1;
+        }
+    }
+
+    uint8_t payload[LORA_MAX_PAYLOAD_SIZE];
+    for (size_t i = 0; i < payloadLen; i++) {
+        payload[i] = (uint8_t)(i * 37 + 11);
+    }
+
+    eventLoop = EventLoop_Create();
+    if (eventLoop == NULL) {
+        fprintf(stderr, "bench: could not create an event loop\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < modules; i++) {
+        lora_cfg_t cfg;
+
+        lora_cfg_setup(&cfg);
+        cfg.hal.path = pty[i];
+        lora_init(&lora[i], &cfg);
+        uartFd[i] = LoRa_hal_uartFd(&lora[i].hal);
+
+        if (!(ioThread ? lora_attach_thread(&lora[i], eventLoop) : lora_attach(&lora[i], eventLoop))) {
+            fprintf(stderr, "bench: could not attach the driver to an event loop\n");
+            return 1;
+        }
+
+        // Reset and boot banner stay out of the first cmd sample
+        uint8_t result = lora_reset(&lora[i]);
+        if (result != LORA_OK) {
+            fprintf(stderr, "bench: module %zu reset failed ( %u )\n", i, result);
+            return 1;
+        }
+    }
+
+    Run(&series[0], "cmd", OpCmd, NULL, iterations, payload, payloadLen);
+    Run(&series[1], "cmd_async", OpCmdAsync, NULL, iterations, payload, payloadLen);
+    Run(&series[2], "join", OpJoin, NULL, iterations, payload, payloadLen);
+    Run(&series[3], "tx_uncnf", OpTxUncnf, NULL, iterations, payload, payloadLen);
+    Run(&series[4], "tx_cnf", OpTxCnf, NULL, iterations, payload, payloadLen);
+    if (modules > 1) {
+        char response[64];
+
+        // The first module joined in the join series
+        for (size_t i = 1; i < modules; i++) {
+            lora_join(&lora[i], "otaa", response);
+        }
+        Run(&series[5], "tx_multi", OpTxMulti, NULL, iterations, payload, payloadLen);
+    }
+
+    // From the slowest rate, the policy climbs as far as the margins allow
+    if (snr != NULL) {
+        char response[64];
+
+        lora_airtime_init();
+        lora_cmd(&lora[0], "mac set dr 0", response);
+        lora_airtime_set_dr(0);
+        lora_link_init(&lora[0], NULL, NULL);
+
+        Run(&series[8], "tx_link", OpTxLink, NULL, iterations, payload, payloadLen);
+    }
+
+    // The session of the last join is what a reset restores
+    if (recovery && control[0] != NULL && mkstemp(storage) != -1) {
+        setenv("LORA_STORAGE", storage, 1);
+        simControl = control[0];
+        lora_session_init(&lora[0]);
+        lora_health_init(&lora[0], NULL, NULL);
+        lora_timeout_conf(&lora[0], BENCH_RECOVERY_TIMEOUT_MS, 0);
+
+        sessionDone = false;
+        if (lora_session_capture_async(SessionCompleted, NULL)) {
+            while (!sessionDone) {
+                if (EventLoop_Run(eventLoop, -1, true) == EventLoop_Run_Failed && errno != EINTR) {
+                    break;
+                }
+            }
+        }
+
+        Run(&series[6], "recover_pause", OpRecoverPause, OpStabilize, iterations, payload,
+            payloadLen);
+        Run(&series[7], "recover_stall", OpRecoverStall, OpStabilize, iterations, payload,
+            payloadLen);
+        lora_health_deinit();
+        unlink(storage);
+    }
+
+    if (!json) {
+        printf("%-13s %6s %5s %10s %10s %10s %10s %9s %8s %8s %8s\n", "command", "n", "fail",
+               "p50_us", "p99_us", "max_us", "cpu_us", "syscalls", "out_B", "in_B", "copy_B");
+    }
+
+    for (size_t i = 0; i < sizeof(series) / sizeof(series[0]); i++) {
+        Report(&series[i], payloadLen, json);
+    }
+
+    if (snr != NULL) {
+        lora_link_status_t link;
+
+        lora_link_status(&link);
+        printf(json ? "{\"link_dr\":%u,\"link_margin_min_db\":%d,\"link_changes\":%u,\"airtime_ms\":%u}\n"
+                    : "link: DR%u, smallest margin %d dB, %u changes, %u ms on air\n",
+               link.dr, link.margin_min, link.changes, lora_airtime_used_ms());
+    }
+
+    for (size_t i = 0; i < modules; i++) {
+        lora_detach(&lora[i]);
+    }
+    EventLoop_Close(eventLoop);
+
+    for (size_t i = 0; i < modules; i++) {
+        if (control[i] != NULL) {
+            fclose(control[i]);
+        }
+        if (sim[i] > 0) {
+            kill(sim[i], SIGTERM);
+            waitpid(sim[i], NULL, 0);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+/* Decoder of uplinks produced by the LoRa_Encode layer.
+
+   Reads one uplink per line on stdin, as the hex payload ("mac tx" argument
+   or network server frame), and prints the records it contains. A batched
+   uplink carries several records back to back. Delta records are resolved
+   against the frames received before, as a network-side decoder would.
+
+   usage: lora_decode -s <channel>:<type>[,<channel>:<type>...] [-j]
+
+   Types are the LoRa_Encode names (temperature, humidity, analog_in...) or
+   Cayenne LPP type ids. Example, the sample application schema:
+
+     echo 00020A | lora_decode -s 1:digital_in,2:presence */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "LoRa.h"
+#include "LoRa_Encode.h"
+#include "string_utilities.h"
+
+#define DECODE_LINE_SIZE (2 * LORA_MAX_PAYLOAD_SIZE + 8)
+#define DECODE_SEQS (LORA_ENC_SEQ_MASK + 1)
+
+static lora_enc_field_t schema[LORA_ENC_MAX_FIELDS];
+static size_t fieldCount;
+
+// Frames received, by sequence number
+static lora_enc_frame_t received[DECODE_SEQS];
+
+static bool ParseSchema(char *spec)
+{
+    char *save = NULL;
+
+    for (char *entry = strtok_r(spec, ",", &save); entry != NULL; entry = strtok_r(NULL, ",", &save)) {
+        char *type = strchr(entry, ':');
+
+        if (type == NULL || fieldCount == LORA_ENC_MAX_FIELDS) {
+            return false;
+        }
+
+        *type++ = '\0';
+        schema[fieldCount].channel = (uint8_t)atoi(entry);
+
+        char *end;
+        long id = strtol(type, &end, 0);
+        if (*end == '\0') {
+            schema[fieldCount].type = (uint8_t)id;
+        } else {
+            // By name: probe the LPP id range
+            int match = -1;
+            for (int candidate = 0; candidate < 256 && match < 0; candidate++) {
+                if (strcmp(lora_enc_type_name((uint8_t)candidate), type) == 0) {
+                    match = candidate;
+                }
+            }
+            if (match < 0) {
+                fprintf(stderr, "decode: unknown type '%s'\n", type);
+                return false;
+            }
+            schema[fieldCount].type = (uint8_t)match;
+        }
+
+        fieldCount++;
+    }
+
+    return fieldCount > 0;
+}
+
+// Keeps the reference window: frames further back than the encoder may refer
+// to are forgotten, so a sequence number reused after wrap-around is never
+// mistaken for an old reference
+static void Remember(const lora_enc_frame_t *frame)
+{
+    for (unsigned age = LORA_ENC_REF_WINDOW; age < DECODE_SEQS; age++) {
+        received[(frame->seq + DECODE_SEQS - age) & LORA_ENC_SEQ_MASK].valid = false;
+    }
+
+    received[frame->seq] = *frame;
+}
+
+// Decodes one record, returns its size or -1
+static ssize_t DecodeRecord(const uint8_t *in, size_t len, bool json)
+{
+    lora_enc_frame_t frame = {.valid = true};
+    const lora_enc_frame_t *ref = NULL;
+    size_t pos = 0;
+
+    if (len < 1) {
+        return -1;
+    }
+
+    bool delta = (in[pos] & LORA_ENC_HDR_DELTA) != 0;
+    frame.seq = in[pos++] & LORA_ENC_SEQ_MASK;
+
+    if (delta) {
+        if (pos >= len) {
+            return -1;
+        }
+        uint8_t refSeq = in[pos++] & LORA_ENC_SEQ_MASK;
+        ref = &received[refSeq];
+        if (!ref->valid || ref->seq != refSeq) {
+            fprintf(stderr, "decode: record %u refers to unknown frame %u\n", frame.seq, refSeq);
+            ref = NULL;
+        }
+    }
+
+    for (size_t i = 0; i < fieldCount; i++) {
+        int32_t value;
+        ssize_t used = lora_enc_varint_get(in + pos, len - pos, &value);
+
+        if (used < 0) {
+            return -1;
+        }
+
+        pos += (size_t)used;
+        frame.raw[i] = ref != NULL ? ref->raw[i] + value : value;
+    }
+
+    if (delta && ref == NULL) {
+        // Size is known, values are not
+        return (ssize_t)pos;
+    }
+
+    Remember(&frame);
+
+    printf(json ? "{\"seq\":%u,\"delta\":%s" : "seq %3u %s", frame.seq,
+           json ? (delta ? "true" : "false") : (delta ? "delta" : "key  "));
+    for (size_t i = 0; i < fieldCount; i++) {
+        double value = frame.raw[i] * lora_enc_resolution(schema[i].type);
+        const char *name = lora_enc_type_name(schema[i].type);
+
+        if (json) {
+            printf(",\"%s_%u\":%g", name, schema[i].channel, value);
+        } else {
+            printf("  ch%u %s=%g", schema[i].channel, name, value);
+        }
+    }
+    printf(json ? "}\n" : "\n");
+
+    return (ssize_t)pos;
+}
+
+int main(int argc, char *argv[])
+{
+    char line[DECODE_LINE_SIZE];
+    uint8_t payload[LORA_MAX_PAYLOAD_SIZE];
+    bool json = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:j")) != -1) {
+        switch (opt) {
+        case 's':
+            if (!ParseSchema(optarg)) {
+                fprintf(stderr, "decode: bad schema\n");
+                return 2;
+            }
+            break;
+        case 'j':
+            json = true;
+            break;
+        default:
+            fieldCount = 0;
+            break;
+        }
+    }
+
+    if (fieldCount == 0) {
+        fprintf(stderr, "usage: %s -s <channel>:<type>[,<channel>:<type>...] [-j]\n", argv[0]);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        size_t hexLen = strcspn(line, " \r\n");
+
+        if (hexLen > 2 * sizeof(payload)) {
+            fprintf(stderr, "decode: uplink longer than %zu bytes\n", sizeof(payload));
+            continue;
+        }
+
+        ssize_t len = hex_decode(payload, line, hexLen);
+
+        if (len < 0) {
+            fprintf(stderr, "decode: malformed line\n");
+            continue;
+        }
+
+        for (size_t pos = 0; pos < (size_t)len;) {
+            ssize_t used = DecodeRecord(payload + pos, (size_t)len - pos, json);
+
+            if (used < 0) {
+                fprintf(stderr, "decode: truncated record\n");
+                break;
+            }
+            pos += (size_t)used;
+        }
+    }
+
+    return 0;
+}
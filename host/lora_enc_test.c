@@ -0,0 +1,199 @@
+/* Round trip of the LoRa_Encode layer through lora_decode.
+
+   Encodes a long sequence of readings as the sample does, batching some
+   records two to an uplink. Some uplinks are lost on the way, and some
+   that arrive are never acknowledged, so delta records are only ever
+   encoded against frames the device saw acknowledged. The uplinks that
+   arrived are fed to lora_decode, which must print every record they
+   carry, with the values encoded, across sequence number wrap-around.
+   Values out of range and steps too large for a delta are checked apart.
+
+   usage: lora_enc_test <path to lora_decode> */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "LoRa.h"
+#include "LoRa_Encode.h"
+#include "string_utilities.h"
+
+#define TEST_UPLINKS 300
+#define TEST_LINE_SIZE 256
+#define TEST_SCHEMA "1:temperature,2:humidity,3:analog_in"
+
+static const lora_enc_field_t schema[] = {
+    {.channel = 1, .type = LORA_ENC_TEMPERATURE},
+    {.channel = 2, .type = LORA_ENC_HUMIDITY},
+    {.channel = 3, .type = LORA_ENC_ANALOG_IN},
+};
+
+#define TEST_FIELDS (sizeof(schema) / sizeof(schema[0]))
+
+// Decoder output expected for each record that arrived, in order
+static char expected[2 * TEST_UPLINKS][TEST_LINE_SIZE];
+static size_t expectedCount;
+
+static void Reading(unsigned i, double *values)
+{
+    values[0] = 20.0 + (i % 7) * 0.3 - (i % 3) * 1.1;
+    values[1] = 40.0 + (i % 11) * 2.5;
+    values[2] = (double)((int)(i * 37 % 200) - 100) / 10.0;
+}
+
+static void Expect(const uint8_t *record, const double *values)
+{
+    char *line = expected[expectedCount++];
+    int len = snprintf(line, TEST_LINE_SIZE, "{\"seq\":%u,\"delta\":%s", record[0] & LORA_ENC_SEQ_MASK,
+                       (record[0] & LORA_ENC_HDR_DELTA) ? "true" : "false");
+
+    for (size_t i = 0; i < TEST_FIELDS; i++) {
+        double resolution = lora_enc_resolution(schema[i].type);
+
+        len += snprintf(line + len, (size_t)(TEST_LINE_SIZE - len), ",\"%s_%u\":%g",
+                        lora_enc_type_name(schema[i].type), schema[i].channel,
+                        (double)lround(values[i] / resolution) * resolution);
+    }
+    snprintf(line + len, (size_t)(TEST_LINE_SIZE - len), "}\n");
+}
+
+// A value beyond int32_t is refused without using up a sequence number,
+// and a step that overflows int32_t goes out as a key frame
+static int CheckLimits(void)
+{
+    const double huge[TEST_FIELDS] = {3e8, 0.0, 0.0};
+    const double low[TEST_FIELDS] = {-2e8, 0.0, 0.0};
+    const double high[TEST_FIELDS] = {2e8, 0.0, 0.0};
+    const double notNumber[TEST_FIELDS] = {NAN, 0.0, 0.0};
+    uint8_t frame[LORA_ENC_MAX_FRAME_SIZE];
+    lora_enc_t enc;
+    int failures = 0;
+
+    lora_enc_init(&enc, schema, TEST_FIELDS);
+
+    ssize_t len = lora_enc_frame(&enc, low, frame, sizeof(frame));
+    lora_enc_ack_frame(&enc, frame, (size_t)len);
+
+    if (lora_enc_frame(&enc, huge, frame, sizeof(frame)) >= 0 ||
+        lora_enc_frame(&enc, notNumber, frame, sizeof(frame)) >= 0) {
+        fprintf(stderr, "enc_test: value out of range encoded\n");
+        failures++;
+    }
+
+    len = lora_enc_frame(&enc, high, frame, sizeof(frame));
+    if (len < 0 || (frame[0] & LORA_ENC_HDR_DELTA) || (frame[0] & LORA_ENC_SEQ_MASK) != 1) {
+        fprintf(stderr, "enc_test: large step not sent as key frame 1\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    char path[] = "/tmp/lora_enc_test_XXXXXX";
+    char command[512];
+    char line[TEST_LINE_SIZE];
+    lora_enc_t enc;
+    unsigned reading = 0;
+    unsigned deltas = 0;
+    size_t checked = 0;
+    int failures = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <path to lora_decode>\n", argv[0]);
+        return 2;
+    }
+
+    int fd = mkstemp(path);
+    FILE *uplinks = fd < 0 ? NULL : fdopen(fd, "w");
+    if (uplinks == NULL) {
+        perror("enc_test: temporary file");
+        return 2;
+    }
+
+    lora_enc_init(&enc, schema, TEST_FIELDS);
+
+    for (unsigned n = 0; n < TEST_UPLINKS; n++) {
+        uint8_t frame[LORA_MAX_PAYLOAD_SIZE];
+        size_t frameLen = 0;
+        size_t records = n % 6 == 5 ? 2 : 1;
+        bool lost = n % 5 == 3;
+        bool acked = !lost && n % 4 != 1;
+        size_t first = expectedCount;
+
+        for (size_t r = 0; r < records; r++) {
+            double values[TEST_FIELDS];
+            Reading(reading++, values);
+
+            ssize_t len = lora_enc_frame(&enc, values, frame + frameLen, sizeof(frame) - frameLen);
+            if (len < 0) {
+                fprintf(stderr, "enc_test: reading %u not encoded\n", reading - 1);
+                return 1;
+            }
+
+            deltas += (frame[frameLen] & LORA_ENC_HDR_DELTA) ? 1 : 0;
+            Expect(frame + frameLen, values);
+            frameLen += (size_t)len;
+        }
+
+        if (lost) {
+            expectedCount = first;
+            continue;
+        }
+
+        char hex[2 * sizeof(frame) + 1];
+        hex[hex_encode(hex, frame, frameLen)] = '\0';
+        fprintf(uplinks, "%s\n", hex);
+
+        // What the sample does for a confirmed uplink the module saw acknowledged
+        if (acked) {
+            lora_enc_ack_frame(&enc, frame, frameLen);
+        }
+    }
+    fclose(uplinks);
+
+    snprintf(command, sizeof(command), "'%s' -s %s -j < '%s'", argv[1], TEST_SCHEMA, path);
+    FILE *decoded = popen(command, "r");
+    if (decoded == NULL) {
+        perror("enc_test: lora_decode");
+        unlink(path);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), decoded) != NULL) {
+        if (checked >= expectedCount || strcmp(line, expected[checked]) != 0) {
+            fprintf(stderr, "enc_test: record %zu\n  decoded  %s  expected %s", checked, line,
+                    checked < expectedCount ? expected[checked] : "nothing\n");
+            failures++;
+        }
+        checked++;
+    }
+
+    int status = pclose(decoded);
+    unlink(path);
+
+    if (checked != expectedCount) {
+        fprintf(stderr, "enc_test: %zu records decoded, %zu expected\n", checked, expectedCount);
+        failures++;
+    }
+    if (deltas == 0) {
+        fprintf(stderr, "enc_test: no delta record encoded\n");
+        failures++;
+    }
+    if (status != 0) {
+        fprintf(stderr, "enc_test: lora_decode exited with %d\n", status);
+        failures++;
+    }
+
+    failures += CheckLimits();
+
+    printf("enc_test: %zu records decoded, %u of %u encoded as delta, %d failures\n", checked,
+           deltas, reading, failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,733 @@
+/* RN2483 simulator for host builds.
+
+   Opens a pseudo-terminal and answers the subset of the RN2483 mac/radio/sys
+   command set used by the driver, with configurable airtime, duty cycle and
+   error injection. The slave side is printed as "PTY <path>" on stdout (and
+   optionally symlinked with -l), to be handed to the driver via LORA_PTY.
+
+   Control commands are read from stdin, one per line:
+     rx <port> <hex>      queue a downlink, delivered on the next uplink
+     inject <fault>       force the fault on the next eligible command
+     set <fault> <prob>   change the probability of a fault (0..1)
+     quit
+
+   Faults: busy, no_free_ch, mac_err, denied, hang (command is swallowed),
+   pause (the MAC pauses until mac resume), stall (nothing is answered
+   until the module is reset).
+
+   With -g, uplinks reach the gateway at that SNR: under the demodulation
+   floor of the data rate they are lost ( mac_err when confirmed ), and
+   with "mac set linkchk" set the margin above the floor is reported in
+   mrgn / gwnb, as a LinkCheckAns would.
+
+   "mac save" keeps the MAC parameters and counters, "sys reset" (also
+   what the driver's reset line sends on the host) reloads them. */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "LoRa_Airtime.h"
+#include "string_utilities.h"
+
+#define SIM_LINE_SIZE 600
+#define SIM_MAX_PARAMS 48
+#define SIM_MAX_DOWNLINKS 8
+
+typedef enum {
+    Fault_Busy,
+    Fault_NoFreeCh,
+    Fault_MacErr,
+    Fault_Denied,
+    Fault_Hang,
+    Fault_Pause,
+    Fault_Stall,
+    Fault_Count
+} Fault;
+
+static const char *faultNames[Fault_Count] = {"busy", "no_free_ch", "mac_err", "denied", "hang",
+                                             "pause", "stall"};
+static double faultProbability[Fault_Count];
+static bool faultForced[Fault_Count];
+
+// Timing, all in milliseconds unless stated otherwise
+static unsigned airtimeMs = 50;
+static unsigned airtimeUsPerByte = 0;
+static unsigned rxWindowsMs = 0;
+static unsigned joinMs = 100;
+static unsigned dutyCyclePercent = 0;
+static bool quiet = false;
+static bool linkSimulated = false;
+static double gatewaySnrDb = 0;
+
+// Module state
+static bool joined = false;
+static bool paused = false;
+static bool stalled = false;
+static int64_t channelFreeAt = 0;
+static uint32_t upCounter = 0;
+static uint32_t downCounter = 0;
+
+// One deferred response (mac_tx_ok, accepted, ...) may be pending at a time
+static char pendingLine[SIM_LINE_SIZE];
+static int64_t pendingDue = -1;
+static bool pendingJoin = false;
+
+static struct {
+    char name[24];
+    char value[64];
+} params[SIM_MAX_PARAMS];
+static size_t paramCount;
+
+// What mac save stored, reloaded by sys reset
+static struct {
+    char name[24];
+    char value[64];
+} savedParams[SIM_MAX_PARAMS];
+static size_t savedParamCount;
+static uint32_t savedUpCounter;
+static uint32_t savedDownCounter;
+
+static struct {
+    unsigned port;
+    char hex[SIM_LINE_SIZE / 2];
+} downlinks[SIM_MAX_DOWNLINKS];
+static size_t downlinkCount;
+
+static int masterFd = -1;
+
+// Largest application payload per EU868 data rate
+static const unsigned maxPayload[8] = {
+    LORA_AIRTIME_PAYLOAD_DR0_2, LORA_AIRTIME_PAYLOAD_DR0_2, LORA_AIRTIME_PAYLOAD_DR0_2,
+    LORA_AIRTIME_PAYLOAD_DR3,   LORA_AIRTIME_PAYLOAD_DR4_7, LORA_AIRTIME_PAYLOAD_DR4_7,
+    LORA_AIRTIME_PAYLOAD_DR4_7, LORA_AIRTIME_PAYLOAD_DR4_7};
+
+static int64_t NowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static bool Inject(Fault fault)
+{
+    if (faultForced[fault]) {
+        faultForced[fault] = false;
+        return true;
+    }
+
+    return faultProbability[fault] > 0 && drand48() < faultProbability[fault];
+}
+
+static int FaultByName(const char *name)
+{
+    for (int i = 0; i < Fault_Count; i++) {
+        if (name != NULL && strcmp(name, faultNames[i]) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static const char *GetParam(const char *name)
+{
+    for (size_t i = 0; i < paramCount; i++) {
+        if (strcmp(params[i].name, name) == 0) {
+            return params[i].value;
+        }
+    }
+
+    return NULL;
+}
+
+static void SetParam(const char *name, const char *value)
+{
+    size_t i;
+
+    for (i = 0; i < paramCount; i++) {
+        if (strcmp(params[i].name, name) == 0) {
+            break;
+        }
+    }
+
+    if (i == paramCount) {
+        if (paramCount == SIM_MAX_PARAMS) {
+            return;
+        }
+        paramCount++;
+    }
+
+    snprintf(params[i].name, sizeof(params[i].name), "%s", name);
+    snprintf(params[i].value, sizeof(params[i].value), "%s", value);
+}
+
+static void ResetMac(void)
+{
+    joined = false;
+    paused = false;
+    upCounter = 0;
+    downCounter = 0;
+    paramCount = 0;
+    pendingDue = -1;
+
+    SetParam("dr", "5");
+    SetParam("adr", "off");
+    SetParam("ar", "off");
+    SetParam("devaddr", "00000000");
+    SetParam("pwridx", "1");
+    SetParam("retx", "7");
+    SetParam("rxdelay1", "1000");
+    SetParam("rx2", "3 869525000");
+    SetParam("mrgn", "255");
+    SetParam("gwnb", "0");
+    SetParam("snr", "7");
+}
+
+static void Respond(const char *line)
+{
+    char frame[SIM_LINE_SIZE + 2];
+    int len = snprintf(frame, sizeof(frame), "%s\r\n", line);
+
+    if (!quiet) {
+        fprintf(stderr, "sim > %s\n", line);
+    }
+
+    if (write(masterFd, frame, (size_t)len) != len) {
+        fprintf(stderr, "sim: short write: %s\n", strerror(errno));
+    }
+}
+
+static void Defer(const char *line, unsigned delayMs)
+{
+    snprintf(pendingLine, sizeof(pendingLine), "%s", line);
+    pendingDue = NowMs() + delayMs;
+}
+
+static unsigned Airtime(size_t payloadLen)
+{
+    return airtimeMs + (unsigned)(airtimeUsPerByte * payloadLen / 1000);
+}
+
+// Returns true when the channel is still in its duty-cycle off period
+static bool ChannelBlocked(void)
+{
+    return NowMs() < channelFreeAt || Inject(Fault_NoFreeCh);
+}
+
+static void ConsumeAirtime(unsigned airtime)
+{
+    if (dutyCyclePercent > 0) {
+        channelFreeAt = NowMs() + airtime + (int64_t)airtime * (100 - dutyCyclePercent) /
+                                                dutyCyclePercent;
+    }
+}
+
+static void HandleMacTx(char *type, char *portText, char *hex)
+{
+    unsigned dr = (unsigned)atoi(GetParam("dr"));
+    size_t hexLen = hex ? strlen(hex) : 0;
+    int port = portText ? atoi(portText) : 0;
+    char line[SIM_LINE_SIZE];
+
+    if (type == NULL || (strcmp(type, "cnf") != 0 && strcmp(type, "uncnf") != 0) || port < 1 ||
+        port > 223 || (hexLen & 1) || hex == NULL) {
+        Respond("invalid_param");
+        return;
+    }
+
+    for (size_t i = 0; i < hexLen; i++) {
+        if (!strchr("0123456789abcdefABCDEF", hex[i])) {
+            Respond("invalid_param");
+            return;
+        }
+    }
+
+    if (!joined) {
+        Respond("not_joined");
+        return;
+    }
+
+    if (paused) {
+        Respond("mac_paused");
+        return;
+    }
+
+    if (hexLen / 2 > maxPayload[dr & 7]) {
+        Respond("invalid_data_len");
+        return;
+    }
+
+    if (Inject(Fault_Busy)) {
+        Respond("busy");
+        return;
+    }
+
+    if (ChannelBlocked()) {
+        Respond("no_free_ch");
+        return;
+    }
+
+    // Demodulation floor: -7.5 dB at SF7 (DR5), 2.5 dB lower per spreading factor
+    bool heard = true;
+    if (linkSimulated) {
+        double floorDb = -7.5 - 2.5 * (5 - (dr > 5 ? 5 : dr));
+        const char *linkchk = GetParam("linkchk");
+
+        heard = gatewaySnrDb >= floorDb;
+        if (heard && linkchk != NULL && atoi(linkchk) > 0) {
+            // Fading: a dB either way from one frame to the next
+            snprintf(line, sizeof(line), "%d", (int)(gatewaySnrDb - floorDb) + (int)(lrand48() % 3) - 1);
+            SetParam("mrgn", line);
+            SetParam("gwnb", "1");
+        }
+    }
+
+    unsigned airtime = Airtime(hexLen / 2);
+    ConsumeAirtime(airtime);
+    upCounter++;
+
+    Respond("ok");
+
+    if (Inject(Fault_MacErr) || (!heard && strcmp(type, "cnf") == 0)) {
+        Defer("mac_err", airtime + rxWindowsMs);
+    } else if (heard && downlinkCount > 0) {
+        snprintf(line, sizeof(line), "mac_rx %u %s", downlinks[0].port, downlinks[0].hex);
+        memmove(&downlinks[0], &downlinks[1], --downlinkCount * sizeof(downlinks[0]));
+        downCounter++;
+        Defer(line, airtime + rxWindowsMs);
+    } else {
+        Defer("mac_tx_ok", airtime + rxWindowsMs);
+    }
+}
+
+static void HandleMacJoin(char *mode)
+{
+    if (mode == NULL || (strcmp(mode, "otaa") != 0 && strcmp(mode, "abp") != 0)) {
+        Respond("invalid_param");
+        return;
+    }
+
+    if (paused) {
+        Respond("mac_paused");
+        return;
+    }
+
+    if (Inject(Fault_Busy)) {
+        Respond("busy");
+        return;
+    }
+
+    if (ChannelBlocked()) {
+        Respond("no_free_ch");
+        return;
+    }
+
+    Respond("ok");
+    pendingJoin = !Inject(Fault_Denied);
+
+    if (strcmp(mode, "abp") == 0) {
+        Defer(pendingJoin ? "accepted" : "denied", 0);
+    } else {
+        // A new session: fresh address, counters restart
+        if (pendingJoin) {
+            char devaddr[12];
+            snprintf(devaddr, sizeof(devaddr), "260B%04X", (unsigned)(lrand48() & 0xFFFF));
+            SetParam("devaddr", devaddr);
+            upCounter = 0;
+            downCounter = 0;
+        }
+        ConsumeAirtime(Airtime(23));
+        Defer(pendingJoin ? "accepted" : "denied", joinMs);
+    }
+}
+
+static void HandleMac(char *sub, char *rest)
+{
+    char *saveptr = NULL;
+    char *arg1 = rest ? strtok_r(rest, " ", &saveptr) : NULL;
+    char *arg2 = arg1 ? strtok_r(NULL, "", &saveptr) : NULL;
+    char value[32];
+
+    if (strcmp(sub, "reset") == 0) {
+        ResetMac();
+        Respond("ok");
+    } else if (strcmp(sub, "tx") == 0) {
+        char *port = arg2 ? strtok_r(arg2, " ", &saveptr) : NULL;
+        char *hex = port ? strtok_r(NULL, " ", &saveptr) : NULL;
+        HandleMacTx(arg1, port, hex);
+    } else if (strcmp(sub, "join") == 0) {
+        HandleMacJoin(arg1);
+    } else if (strcmp(sub, "save") == 0) {
+        memcpy(savedParams, params, sizeof(params));
+        savedParamCount = paramCount;
+        savedUpCounter = upCounter;
+        savedDownCounter = downCounter;
+        Respond("ok");
+    } else if (strcmp(sub, "forceENABLE") == 0) {
+        Respond("ok");
+    } else if (strcmp(sub, "pause") == 0) {
+        paused = true;
+        Respond("4294967245");
+    } else if (strcmp(sub, "resume") == 0) {
+        paused = false;
+        Respond("ok");
+    } else if (strcmp(sub, "set") == 0) {
+        if (arg1 == NULL || arg2 == NULL) {
+            Respond("invalid_param");
+            return;
+        }
+        if (strcmp(arg1, "upctr") == 0) {
+            upCounter = (uint32_t)strtoul(arg2, NULL, 10);
+        } else if (strcmp(arg1, "dnctr") == 0) {
+            downCounter = (uint32_t)strtoul(arg2, NULL, 10);
+        }
+        SetParam(arg1, arg2);
+        Respond("ok");
+    } else if (strcmp(sub, "get") == 0) {
+        if (arg1 == NULL) {
+            Respond("invalid_param");
+        } else if (strcmp(arg1, "status") == 0) {
+            snprintf(value, sizeof(value), "%08X", (joined ? 0x01u : 0) | (paused ? 0 : 0x02u));
+            Respond(value);
+        } else if (strcmp(arg1, "upctr") == 0) {
+            snprintf(value, sizeof(value), "%u", upCounter);
+            Respond(value);
+        } else if (strcmp(arg1, "dnctr") == 0) {
+            snprintf(value, sizeof(value), "%u", downCounter);
+            Respond(value);
+        } else {
+            const char *stored = GetParam(arg1);
+            Respond(stored ? stored : "invalid_param");
+        }
+    } else {
+        Respond("invalid_param");
+    }
+}
+
+static void HandleRadio(char *sub, char *rest)
+{
+    char *saveptr = NULL;
+    char *arg1 = rest ? strtok_r(rest, " ", &saveptr) : NULL;
+
+    if (strcmp(sub, "tx") == 0 || strcmp(sub, "rx") == 0) {
+        if (!paused) {
+            Respond("busy");
+            return;
+        }
+        if (arg1 == NULL) {
+            Respond("invalid_param");
+            return;
+        }
+        Respond("ok");
+        if (strcmp(sub, "tx") == 0) {
+            Defer("radio_tx_ok", Airtime(strlen(arg1) / 2));
+        } else {
+            Defer("radio_err", 100);
+        }
+    } else if (strcmp(sub, "set") == 0) {
+        Respond(arg1 ? "ok" : "invalid_param");
+    } else if (strcmp(sub, "get") == 0 && arg1 != NULL) {
+        const char *stored = GetParam(arg1);
+        Respond(stored ? stored : "0");
+    } else {
+        Respond("invalid_param");
+    }
+}
+
+static void HandleSys(char *sub, char *rest)
+{
+    if (strcmp(sub, "reset") == 0) {
+        ResetMac();
+        if (savedParamCount > 0) {
+            memcpy(params, savedParams, sizeof(params));
+            paramCount = savedParamCount;
+            upCounter = savedUpCounter;
+            downCounter = savedDownCounter;
+        }
+        Respond("RN2483 1.0.5 Oct 31 2018 15:06:52");
+    } else if (strcmp(sub, "factoryRESET") == 0) {
+        ResetMac();
+        savedParamCount = 0;
+        Respond("RN2483 1.0.5 Oct 31 2018 15:06:52");
+    } else if (strcmp(sub, "get") == 0 && rest != NULL && strncmp(rest, "ver", 3) == 0) {
+        Respond("RN2483 1.0.5 Oct 31 2018 15:06:52");
+    } else if (strcmp(sub, "get") == 0 && rest != NULL && strncmp(rest, "hweui", 5) == 0) {
+        Respond("0004A30B001A2B3C");
+    } else if (strcmp(sub, "get") == 0 && rest != NULL && strncmp(rest, "vdd", 3) == 0) {
+        Respond("3300");
+    } else if (strcmp(sub, "sleep") == 0 && rest != NULL) {
+        Defer("ok", (unsigned)atoi(rest));
+    } else {
+        Respond("invalid_param");
+    }
+}
+
+static void HandleCommand(char *line)
+{
+    char *saveptr = NULL;
+    char *family = strtok_r(line, " ", &saveptr);
+    char *sub = family ? strtok_r(NULL, " ", &saveptr) : NULL;
+    char *rest = sub ? strtok_r(NULL, "", &saveptr) : NULL;
+
+    if (family == NULL || sub == NULL) {
+        Respond("invalid_param");
+        return;
+    }
+
+    // Stalled: only a reset gets through
+    if (stalled || Inject(Fault_Stall)) {
+        stalled = strcmp(family, "sys") != 0 || strcmp(sub, "reset") != 0;
+        if (stalled) {
+            if (!quiet) {
+                fprintf(stderr, "sim: stalled on '%s %s'\n", family, sub);
+            }
+            return;
+        }
+    }
+
+    if (strcmp(family, "mac") == 0 && strcmp(sub, "resume") != 0 && Inject(Fault_Pause)) {
+        paused = true;
+    }
+
+    if (Inject(Fault_Hang)) {
+        if (!quiet) {
+            fprintf(stderr, "sim: hanging on '%s %s'\n", family, sub);
+        }
+        return;
+    }
+
+    // Only sys commands are served while a transaction is in the air
+    if (pendingDue >= 0 && strcmp(family, "sys") != 0) {
+        Respond("busy");
+        return;
+    }
+
+    if (strcmp(family, "mac") == 0) {
+        HandleMac(sub, rest);
+    } else if (strcmp(family, "radio") == 0) {
+        HandleRadio(sub, rest);
+    } else if (strcmp(family, "sys") == 0) {
+        HandleSys(sub, rest);
+    } else {
+        Respond("invalid_param");
+    }
+}
+
+static void HandleControl(char *line)
+{
+    char *saveptr = NULL;
+    char *verb = strtok_r(line, " \n", &saveptr);
+    char *arg1;
+    char *arg2;
+    int fault;
+
+    if (verb == NULL) {
+        return;
+    }
+
+    arg1 = strtok_r(NULL, " \n", &saveptr);
+    arg2 = arg1 ? strtok_r(NULL, " \n", &saveptr) : NULL;
+
+    if (strcmp(verb, "quit") == 0) {
+        exit(0);
+    } else if (strcmp(verb, "rx") == 0 && arg1 && arg2 && downlinkCount < SIM_MAX_DOWNLINKS) {
+        downlinks[downlinkCount].port = (unsigned)atoi(arg1);
+        snprintf(downlinks[downlinkCount].hex, sizeof(downlinks[0].hex), "%s", arg2);
+        downlinkCount++;
+    } else if (strcmp(verb, "inject") == 0 && (fault = FaultByName(arg1)) >= 0) {
+        faultForced[fault] = true;
+    } else if (strcmp(verb, "set") == 0 && (fault = FaultByName(arg1)) >= 0 && arg2) {
+        faultProbability[fault] = atof(arg2);
+    } else {
+        fprintf(stderr, "sim: unknown control '%s'\n", verb);
+    }
+}
+
+static int OpenPty(const char *linkPath)
+{
+    struct termios tio;
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (fd == -1 || grantpt(fd) == -1 || unlockpt(fd) == -1) {
+        perror("sim: posix_openpt");
+        return -1;
+    }
+
+    const char *slave = ptsname(fd);
+
+    // Keep a slave handle open, so the master never sees a hangup while
+    // the driver reopens the device.
+    int slaveFd = open(slave, O_RDWR | O_NOCTTY);
+    if (slaveFd != -1 && tcgetattr(slaveFd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(slaveFd, TCSANOW, &tio);
+    }
+
+    if (linkPath != NULL) {
+        unlink(linkPath);
+        if (symlink(slave, linkPath) == -1) {
+            perror("sim: symlink");
+        }
+    }
+
+    printf("PTY %s\n", slave);
+    fflush(stdout);
+
+    return fd;
+}
+
+static void Usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-l link] [-a airtime_ms] [-b airtime_us_per_byte] [-w rx_windows_ms]\n"
+            "          [-j join_ms] [-d duty_cycle_percent] [-e fault=prob]... [-g gateway_snr_db]\n"
+            "          [-s seed] [-q]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *linkPath = NULL;
+    long seed = (long)time(NULL);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:a:b:w:j:d:e:g:s:q")) != -1) {
+        switch (opt) {
+        case 'l':
+            linkPath = optarg;
+            break;
+        case 'a':
+            airtimeMs = (unsigned)atoi(optarg);
+            break;
+        case 'b':
+            airtimeUsPerByte = (unsigned)atoi(optarg);
+            break;
+        case 'w':
+            rxWindowsMs = (unsigned)atoi(optarg);
+            break;
+        case 'j':
+            joinMs = (unsigned)atoi(optarg);
+            break;
+        case 'd':
+            dutyCyclePercent = (unsigned)atoi(optarg);
+            break;
+        case 'e': {
+            char *eq = strchr(optarg, '=');
+            int fault;
+            if (eq == NULL) {
+                Usage(argv[0]);
+            }
+            *eq = '\0';
+            if ((fault = FaultByName(optarg)) < 0) {
+                Usage(argv[0]);
+            }
+            faultProbability[fault] = atof(eq + 1);
+            break;
+        }
+        case 'g':
+            linkSimulated = true;
+            gatewaySnrDb = atof(optarg);
+            break;
+        case 's':
+            seed = atol(optarg);
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            Usage(argv[0]);
+        }
+    }
+
+    srand48(seed);
+    ResetMac();
+
+    masterFd = OpenPty(linkPath);
+    if (masterFd == -1) {
+        return 1;
+    }
+
+    char line[SIM_LINE_SIZE];
+    size_t lineLen = 0;
+    char control[SIM_LINE_SIZE];
+    size_t controlLen = 0;
+    bool stdinOpen = true;
+
+    for (;;) {
+        struct pollfd fds[2] = {{.fd = masterFd, .events = POLLIN},
+                                {.fd = stdinOpen ? STDIN_FILENO : -1, .events = POLLIN}};
+        int timeout = -1;
+
+        if (pendingDue >= 0) {
+            int64_t left = pendingDue - NowMs();
+            timeout = left > 0 ? (int)left : 0;
+        }
+
+        if (poll(fds, 2, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("sim: poll");
+            return 1;
+        }
+
+        if (pendingDue >= 0 && NowMs() >= pendingDue) {
+            pendingDue = -1;
+            if (strcmp(pendingLine, "accepted") == 0) {
+                joined = pendingJoin;
+            }
+            Respond(pendingLine);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char chunk[256];
+            ssize_t len = read(masterFd, chunk, sizeof(chunk));
+
+            for (ssize_t i = 0; i < len; i++) {
+                if (chunk[i] == '\r') {
+                    continue;
+                }
+                if (chunk[i] == '\n') {
+                    line[lineLen] = '\0';
+                    if (!quiet) {
+                        fprintf(stderr, "sim < %s\n", line);
+                    }
+                    if (lineLen > 0) {
+                        HandleCommand(line);
+                    }
+                    lineLen = 0;
+                } else if (lineLen < sizeof(line) - 1) {
+                    line[lineLen++] = chunk[i];
+                }
+            }
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            ssize_t len = read(STDIN_FILENO, control + controlLen, 1);
+
+            if (len <= 0) {
+                stdinOpen = false;
+            } else if (control[controlLen] == '\n' || controlLen == sizeof(control) - 2) {
+                control[controlLen + 1] = '\0';
+                HandleControl(control);
+                controlLen = 0;
+            } else {
+                controlLen++;
+            }
+        }
+    }
+}
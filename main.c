@@ -30,9 +30,20 @@
 #include <applibs/eventloop.h>
 
 #include "eventloop_timer_utilities.h"
+#include "gpio_input_utilities.h"
 #include "peripheral_utilities.h"
 #include "string_utilities.h"
 #include "LoRa.h"
+#include "LoRa_Airtime.h"
+#include "LoRa_Batch.h"
+#include "LoRa_Downlink.h"
+#include "LoRa_Encode.h"
+#include "LoRa_Health.h"
+#include "LoRa_Join.h"
+#include "LoRa_Link.h"
+#include "LoRa_Log.h"
+#include "LoRa_Session.h"
+#include "LoRa_Uplink.h"
 
 /// <summary>
 /// Exit codes for this application. These are used for the
@@ -49,15 +60,19 @@ typedef enum {
     ExitCode_Init_ButtonPollTimer = 6,
     ExitCode_Main_EventLoopFail = 7,
     ExitCode_Init_ReconnectTimer = 8,
-    ExitCode_Init_SenMessageTimer = 9
+    ExitCode_Init_SenMessageTimer = 9,
+    ExitCode_Init_LoRaAttach = 10,
+    ExitCode_Init_UplinkQueue = 11,
+    ExitCode_Init_Batch = 12,
+    ExitCode_Init_Join = 13,
+    ExitCode_Init_StatusTimer = 14,
+    ExitCode_Init_LoRaReset = 15
 } ExitCode;
 
 // File descriptors - initialized to invalid value
 static int gpioButtonFd = -1;
 
 char sendMessage[] = "Hello World From LoRa";
-char tmp_txt[ 50 ];
-char sendHex[ 50 ];
 char rspTxt[ 50 ];
 char rsp_data[10];
 uint8_t cnt;
@@ -70,21 +85,54 @@ char LORA_CMD_MAC_PAUSE[] = "mac pause";
 char LORA_CMD_RADIO_SET_WDT[] = "radio set wdt 0";
 char LORA_ARG_0[] = "0";
 
+// Telemetry batches: confirmed, so that acknowledged records can serve as delta bases
+#define TELEMETRY_PORT 1
+#define TELEMETRY_FLAGS LORA_UPLINK_CONFIRMED
+
+// Downlink port of configuration pushes
+#define CONFIG_PORT 2
+
+// Radio health report: driver metrics on their own port, every 6 hours
+#define STATUS_PORT 3
+#define STATUS_PERIOD_S (6 * 60 * 60)
+#define STATUS_VERSION 2
+
+// Provisioning sequence, streamed to the module on start
+static lora_script_step_t provisioningScript[] = {
+    {.cmd = "mac reset 868"},
+    {.cmd = "mac set deveui 9ABB196487A3E9D3"},
+    {.cmd = "mac set appeui F33F1B9432896391"},
+    {.cmd = "mac set appkey D6FE7596B8974EBF09314AC0C17AB307"},
+    // The data rate follows the link margins locally, see LoRa_Link.c
+    {.cmd = "mac set adr off"},
+    {.cmd = "mac set ar off"},
+    {.cmd = "mac save"},
+};
+
+// Telemetry record: button state and number of presses, delta encoded
+static const lora_enc_field_t telemetrySchema[] = {
+    {.channel = 1, .type = LORA_ENC_DIGITAL_IN},
+    {.channel = 2, .type = LORA_ENC_PRESENCE},
+};
+static lora_enc_t telemetryEncoder;
+static unsigned buttonPresses = 0;
+
 static bool connected = false;
 
+// The radio, on click socket 1
+static lora_ctx_t lora;
+
 EventLoop *eventLoop = NULL;
-EventLoopTimer *buttonPollTimer = NULL;
-EventLoopTimer *reconnectTimer = NULL;
+GpioInput *button = NULL;
 EventLoopTimer *sendMessageTimer = NULL;
-
-// State variables
-static GPIO_Value_Type buttonState = GPIO_Value_High;
+EventLoopTimer *statusTimer = NULL;
 
 // Termination state
 static volatile sig_atomic_t exitCode = ExitCode_Success;
 
 static void TerminationHandler(int signalNumber);
-static void ButtonTimerEventHandler(EventLoopTimer *timer);
+static void ButtonEventHandler(GpioInput *input, GpioInputEvent event, void *context);
+static void TrySendMessage(bool urgent);
 static ExitCode InitPeripheralsAndHandlers(void);
 static void ClosePeripheralsAndHandlers(void);
 
@@ -97,75 +145,221 @@ static void TerminationHandler(int signalNumber)
     exitCode = ExitCode_TermHandler_SigTerm;
 }
 
-static void TryConnectToLoRaNetwork(void)
+/// <summary>
+///     Completion of the session capture that follows an OTAA join.
+/// </summary>
+static void SessionCapturedHandler(uint8_t result, void *context)
 {
-    if (connected)
-    {
-        return;
+    if (result != LORA_OK) {
+        Log_Debug("Session not stored, the next start joins again: %d\n", result);
     }
 
-    lora_join( "otaa", &tmp_txt[0]);
+    lora_uplink_enable(true);
+}
 
-    if ( strcmp(trim(tmp_txt), "accepted") == 0 ){
-        Log_Debug("Device successfully connected.\n");
+/// <summary>
+///     Outcome of each join attempt, invoked from the event loop.
+/// </summary>
+static void JoinStateHandler(const lora_join_status_t *status, void *context)
+{
+    if (status->state == LORA_JOIN_JOINED) {
+        Log_Debug("Device successfully connected at DR%u.\n", status->dr);
         connected = true;
+        lora_link_restart();
+
+        // Keep the new session for the next start, uplinks wait until it is stored
+        if (!lora_session_capture_async(SessionCapturedHandler, NULL)) {
+            lora_uplink_enable(true);
+        }
     }
     else {
-        Log_Debug("Device is not connected: %s\n", tmp_txt);
+        Log_Debug("Device is not connected (%d), attempt %u in %u s.\n", status->result,
+                  status->attempts + 1, status->backoff_ms / 1000);
     }
 }
 
-static void ReconnectEventHandler(EventLoopTimer *timer)
-{    
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_ButtonTimer_Consume;
-        return;
+/// <summary>
+///     Completion of the provisioning script: report failures and join.
+/// </summary>
+static void ProvisioningCompletedHandler(lora_script_step_t *steps, size_t count, size_t failed,
+                                         void *context)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (steps[i].result != 0) {
+            Log_Debug("Provisioning step '%s' failed: %s (%d)\n", steps[i].cmd,
+                      steps[i].response, steps[i].result);
+        }
     }
 
-    TryConnectToLoRaNetwork();
+    Log_Debug("Provisioning done, %zu of %zu commands failed.\n", failed, count);
+
+    lora_join_start();
 }
 
-static void TrySendMessage(void)
+static void StartProvisioning(void)
 {
-    if (!connected)
-    {
-        Log_Debug("Cannot send a message since the device is offline.");
+    if (!lora_script_async(&lora, provisioningScript,
+                           sizeof(provisioningScript) / sizeof(provisioningScript[0]),
+                           ProvisioningCompletedHandler, NULL)) {
+        // Join with what the module saved last time, the join backoff retries
+        Log_Debug("Provisioning not started, radio busy.\n");
+        lora_join_start();
+    }
+}
+
+/// <summary>
+///     Completion of the stored session restore: resume it, or provision and join.
+/// </summary>
+static void SessionRestoredHandler(uint8_t result, void *context)
+{
+    if (result == LORA_OK) {
+        Log_Debug("Device connected with the stored session.\n");
+        connected = true;
+        lora_link_restart();
+        lora_uplink_enable(true);
         return;
     }
 
-    uint8_t resp = lora_mac_tx("cnf", "1", "48656C6C6F", &tmp_txt[0]);
+    Log_Debug("Stored session not resumed: %d\n", result);
+    lora_session_clear();
+    StartProvisioning();
+}
+
+/// <summary>
+///     End of the start-up reset: resume the stored session, or provision then join.
+/// </summary>
+static void RadioResetHandler(uint8_t result, const lora_rsp_view_t *rsp, void *context)
+{
+    // Without a banner the module may still answer, the health supervisor steps in if not
+    if (result != LORA_OK) {
+        Log_Debug("Radio boot banner missing: %d\n", result);
+    }
 
-    if ( resp != 0) {
-        Log_Debug("Packet was not transmit: %d", resp);
+    if (!lora_session_restore_async(SessionRestoredHandler, NULL)) {
+        StartProvisioning();
     }
 }
 
 /// <summary>
-///     Handle button timer event: if the button is pressed, send data over the UART.
+///     Outcome of each uplink transmission, invoked from the event loop.
 /// </summary>
-static void ButtonTimerEventHandler(EventLoopTimer *timer)
+static void UplinkHandler(uint8_t port, const uint8_t *data, size_t len, uint8_t result, bool final,
+                          void *context)
 {
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_ButtonTimer_Consume;
+    if (result == LORA_OK || result == LORA_MAC_RX) {
+        // Confirmed telemetry: the network has these records, later ones are encoded
+        // against them. Other ports do not carry encoder frames.
+        if (port == TELEMETRY_PORT && (TELEMETRY_FLAGS & LORA_UPLINK_CONFIRMED)) {
+            lora_enc_ack_frame(&telemetryEncoder, data, len);
+        }
+
+        // More downlinks may be queued: each uplink opens the next receive windows
+        if (lora_downlink_pending(&lora)) {
+            TrySendMessage(false);
+            lora_batch_flush();
+        }
         return;
     }
 
-    // Check for a button press
-    GPIO_Value_Type newButtonState;
-    int result = GPIO_GetValue(gpioButtonFd, &newButtonState);
-    if (result != 0) {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
-        exitCode = ExitCode_ButtonTimer_GetValue;
+    Log_Debug("Packet on port %d was not transmit: %d%s\n", port, result,
+              final ? ", dropped" : ", will retry");
+
+    // The queue holds its messages until the device has joined again
+    if (result == LORA_ERR_NOT_JOINED || result == LORA_ERR_FRAME_COUNTER ||
+        result == LORA_ERR_KEYS_NOT_INIT) {
+        connected = false;
+        // The stored session is of no use any more: join again, with backoff
+        lora_session_clear();
+        lora_join_start();
+    }
+}
+
+/// <summary>
+///     End of a radio recovery: join again when the reset module kept no session.
+/// </summary>
+static void HealthHandler(const lora_health_status_t *status, void *context)
+{
+    Log_Debug("Radio recovery %s in %u ms.\n", status->recovered_f ? "done" : "failed",
+              status->recovery_ms);
+
+    // A reset module has forgotten its link check interval
+    if (status->reached >= LORA_HEALTH_SOFT_RESET) {
+        lora_link_restart();
+    }
+
+    if (status->session_lost_f) {
+        connected = false;
+        lora_session_clear();
+        lora_join_start();
+    }
+}
+
+/// <summary>
+///     Data rate changes of the link policy.
+/// </summary>
+static void LinkHandler(const lora_link_status_t *status, void *context)
+{
+    Log_Debug("Data rate now DR%u, smallest margin %d dB over %u gateway(s).\n", status->dr,
+              status->margin_min, status->gateways);
+}
+
+/// <summary>
+///     Downlink on a port without handler.
+/// </summary>
+static void DownlinkHandler(uint8_t port, const uint8_t *data, size_t len, void *context)
+{
+    Log_Debug("Downlink received on port %d, %zu bytes.\n", port, len);
+}
+
+/// <summary>
+///     Configuration downlink: telemetry period in seconds, 16 bits big endian.
+/// </summary>
+static void ConfigDownlinkHandler(uint8_t port, const uint8_t *data, size_t len, void *context)
+{
+    unsigned period = len == 2 ? (unsigned)data[0] << 8 | data[1] : 0;
+
+    if (period == 0) {
+        Log_Debug("Malformed configuration downlink, %zu bytes.\n", len);
         return;
     }
 
-    // If the button has just been pressed, send data over the UART
-    // The button has GPIO_Value_Low when pressed and GPIO_Value_High when released
-    if (newButtonState != buttonState) {
-        if (newButtonState == GPIO_Value_Low) {
-            TrySendMessage();
-            buttonState = newButtonState;
-        }
+    struct timespec sendMessagePeriod = {.tv_sec = period, .tv_nsec = 0};
+    SetEventLoopTimerPeriod(sendMessageTimer, &sendMessagePeriod);
+    Log_Debug("Telemetry period set to %u s.\n", period);
+}
+
+/// <summary>
+///     Add a reading to the current batch; urgent ones are sent at once with the batch.
+///     Batches are sent as soon as the device is joined and the radio is free.
+/// </summary>
+static void TrySendMessage(bool urgent)
+{
+    double values[] = {urgent ? 1 : 0, buttonPresses};
+    uint8_t record[LORA_ENC_MAX_FRAME_SIZE];
+    size_t room = lora_airtime_max_payload(lora_airtime_dr());
+    ssize_t len = lora_enc_frame(&telemetryEncoder, values, record,
+                                 room < sizeof(record) ? room : sizeof(record));
+
+    if (len < 0 || !lora_batch_add(record, (size_t)len, urgent)) {
+        Log_Debug("Packet was not queued.\n");
+    }
+}
+
+/// <summary>
+///     Handle button events: each press sends its reading at once.
+/// </summary>
+static void ButtonEventHandler(GpioInput *input, GpioInputEvent event, void *context)
+{
+    switch (event) {
+    case GpioInputEvent_Pressed:
+        buttonPresses++;
+        TrySendMessage(true);
+        break;
+    case GpioInputEvent_Released:
+        break;
+    case GpioInputEvent_Error:
+        exitCode = ExitCode_ButtonTimer_GetValue;
+        break;
     }
 }
 
@@ -176,7 +370,66 @@ static void SendDeviceMessageHandler(EventLoopTimer *timer)
         return;
     }
 
-    TrySendMessage();
+    // Periodic readings travel together, several per uplink
+    TrySendMessage(false);
+}
+
+/// <summary>
+///     Radio health report: a version byte, then unsigned varints of the driver metrics,
+///     the mac tx latency histogram last. The histogram ends at its last non-empty
+///     bucket, or earlier when the report would not fit the current data rate.
+///     Counters restart once a report is queued.
+/// </summary>
+static void SendStatusHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        exitCode = ExitCode_ButtonTimer_Consume;
+        return;
+    }
+
+    lora_metrics_t metrics;
+    uint8_t report[5 * (9 + LORA_METRICS_LATENCY_BUCKETS) + 1];
+    size_t room = lora_airtime_max_payload(lora_airtime_dr());
+    size_t len = 0;
+    size_t buckets = LORA_METRICS_LATENCY_BUCKETS;
+    uint32_t errors = 0;
+
+    lora_metrics(&lora, &metrics);
+    for (size_t i = LORA_OK + 1; i < LORA_METRICS_RESULTS; i++) {
+        errors += i == LORA_MAC_RX ? 0 : metrics.results[i];
+    }
+
+    uint32_t fields[] = {metrics.commands[LORA_KIND_MAC_TX], metrics.commands[LORA_KIND_MAC_JOIN],
+                         metrics.joins_accepted, metrics.downlinks, errors,
+                         metrics.results[LORA_ERR_TIMEOUT], metrics.rx_overflows,
+                         metrics.airtime_ms / 1000, metrics.bytes_out + metrics.bytes_in};
+
+    report[len++] = STATUS_VERSION;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        len += lora_enc_uvarint_put(report + len, fields[i]);
+    }
+    if (len > room) {
+        Log_Debug("Health report of %zu bytes does not fit, kept for later.\n", len);
+        return;
+    }
+
+    while (buckets > 0 && metrics.latency[LORA_KIND_MAC_TX][buckets - 1] == 0) {
+        buckets--;
+    }
+    for (size_t i = 0; i < buckets; i++) {
+        uint8_t bucket[5];
+        size_t n = lora_enc_uvarint_put(bucket, metrics.latency[LORA_KIND_MAC_TX][i]);
+
+        if (len + n > room) {
+            break;
+        }
+        memcpy(report + len, bucket, n);
+        len += n;
+    }
+
+    if (lora_uplink_submit(STATUS_PORT, report, len, LORA_UPLINK_PRIO_TELEMETRY, 0)) {
+        lora_metrics_reset(&lora);
+    }
 }
 
 /// <summary>
@@ -199,39 +452,66 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return ExitCode_Init_EventLoop;
     }
 
-    // Open SAMPLE_BUTTON_1 GPIO as input, and set up a timer to poll it
+    // Open SAMPLE_BUTTON_1 GPIO as input, and watch it: polled slowly at rest, fast
+    // while a press or release is being debounced
     Log_Debug("Opening SAMPLE_BUTTON_1 as input.\n");
     gpioButtonFd = GPIO_OpenAsInput(AVNET_MT3620_SK_USER_BUTTON_A);
     if (gpioButtonFd == -1) {
         Log_Debug("ERROR: Could not open button GPIO: %s (%d).\n", strerror(errno), errno);
         return ExitCode_Init_OpenButton;
     }
-    struct timespec buttonPressCheckPeriod1Ms = {.tv_sec = 0, .tv_nsec = 1000 * 1000};
-    buttonPollTimer = CreateEventLoopPeriodicTimer(eventLoop, ButtonTimerEventHandler,
-                                                   &buttonPressCheckPeriod1Ms);
-    if (buttonPollTimer == NULL) {
-        return ExitCode_Init_ReconnectTimer;
+    button = CreateGpioInput(eventLoop, gpioButtonFd, &GpioInputConfig_Button, ButtonEventHandler,
+                             NULL);
+    if (button == NULL) {
+        return ExitCode_Init_ButtonPollTimer;
     }
 
-    lora_init();
-    lora_process();
+    lora_cfg_t loraCfg;
+    lora_cfg_setup(&loraCfg);
+    lora_init(&lora, &loraCfg);
+    lora_process(&lora);
+
+    // From now on responses are handled by the event loop as they arrive
+#ifdef LORA_IO_THREAD
+    if (!lora_attach_thread(&lora, eventLoop)) {
+#else
+    if (!lora_attach(&lora, eventLoop)) {
+#endif
+        return ExitCode_Init_LoRaAttach;
+    }
 
-    // start
-    lora_cmd( "mac reset 868", &tmp_txt[0]);
-    lora_cmd( "mac set deveui 9ABB196487A3E9D3", &tmp_txt[0]);
-    lora_cmd( "mac set appeui F33F1B9432896391", &tmp_txt[0]);
-    lora_cmd( "mac set appkey D6FE7596B8974EBF09314AC0C17AB307", &tmp_txt[0]);
-    lora_cmd( "mac set adr off", &tmp_txt[0]);
-    lora_cmd( "mac set ar off", &tmp_txt[0]);
-    lora_cmd( "mac save", &tmp_txt[0]);
+    lora_downlink_init(&lora);
+    lora_downlink_set_default(DownlinkHandler, NULL);
+    lora_downlink_register(CONFIG_PORT, ConfigDownlinkHandler, NULL);
 
-    TryConnectToLoRaNetwork();
+    lora_airtime_init();
 
-    struct timespec reconnectCheckPeriod1m = {.tv_sec = 60, .tv_nsec = 0};
-    reconnectTimer = CreateEventLoopPeriodicTimer(eventLoop, ReconnectEventHandler,
-                                                            &reconnectCheckPeriod1m);
-    if (reconnectTimer == NULL) {
-        return ExitCode_Init_ReconnectTimer;
+    if (!lora_uplink_init(&lora, eventLoop, UplinkHandler, NULL)) {
+        return ExitCode_Init_UplinkQueue;
+    }
+
+    lora_enc_init(&telemetryEncoder, telemetrySchema,
+                  sizeof(telemetrySchema) / sizeof(telemetrySchema[0]));
+
+    if (!lora_batch_init(eventLoop, TELEMETRY_PORT, LORA_BATCH_DEADLINE_MS, TELEMETRY_FLAGS)) {
+        return ExitCode_Init_Batch;
+    }
+
+    if (!lora_join_init(&lora, eventLoop, JoinStateHandler, NULL)) {
+        return ExitCode_Init_Join;
+    }
+
+    lora_session_init(&lora);
+
+    // Failing commands from now on get the module probed, resumed or reset
+    lora_health_init(&lora, HealthHandler, NULL);
+
+    // Link margins are read back after each uplink, the data rate follows them
+    lora_link_init(&lora, LinkHandler, NULL);
+
+    // start: reset the module, the commands begin from the completion handler
+    if (!lora_reset_async(&lora, RadioResetHandler, NULL)) {
+        return ExitCode_Init_LoRaReset;
     }
 
     struct timespec sendMessageCheckPeriod1m = {.tv_sec = 60, .tv_nsec = 0};
@@ -241,6 +521,12 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return ExitCode_Init_SenMessageTimer;
     }    
 
+    struct timespec statusPeriod = {.tv_sec = STATUS_PERIOD_S, .tv_nsec = 0};
+    statusTimer = CreateEventLoopPeriodicTimer(eventLoop, SendStatusHandler, &statusPeriod);
+    if (statusTimer == NULL) {
+        return ExitCode_Init_StatusTimer;
+    }
+
     return ExitCode_Success;
 }
 
@@ -249,10 +535,16 @@ static ExitCode InitPeripheralsAndHandlers(void)
 /// </summary>
 static void ClosePeripheralsAndHandlers(void)
 {
-    DisposeEventLoopTimer(buttonPollTimer);
-    DisposeEventLoopTimer(reconnectTimer);
+    DisposeGpioInput(button);
     DisposeEventLoopTimer(sendMessageTimer);
-
+    DisposeEventLoopTimer(statusTimer);
+
+    lora_batch_deinit();
+    lora_join_deinit();
+    lora_downlink_deinit();
+    lora_uplink_deinit();
+    lora_health_deinit();
+    lora_detach(&lora);
     EventLoop_Close(eventLoop);
 
     Log_Debug("Closing file descriptors.\n");
@@ -278,6 +570,11 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Last radio events before a failure, for the post-mortem
+    if (exitCode != ExitCode_Success && exitCode != ExitCode_TermHandler_SigTerm) {
+        lora_trace_dump();
+    }
+
     ClosePeripheralsAndHandlers();
     Log_Debug("Application exiting.\n");
     return exitCode;
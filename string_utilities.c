@@ -50,4 +50,53 @@ char *rtrim(char *s)
 char *trim(char *s) 
 {     
     return rtrim(ltrim(s));  
-} 
\ No newline at end of file
+}
+
+static const char hex_digits[16] = "0123456789ABCDEF";
+
+/* Nibble value + 1, so that zero marks a non hex character */
+static const uint8_t hex_values[256] =
+{
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+/*
+ * Writes 2 * len upper case hex digits to dst, without terminator.
+ * Returns the number of characters written. */
+size_t hex_encode(char *dst, const uint8_t *src, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        dst[2 * i]     = hex_digits[src[i] >> 4];
+        dst[2 * i + 1] = hex_digits[src[i] & 0x0F];
+    }
+
+    return 2 * len;
+}
+
+/*
+ * Decodes len hex digits from src into dst. dst may alias src, since
+ * each byte is written behind the digits it was read from.
+ * Returns the number of bytes written, or -1 on an odd length or a
+ * non hex character. */
+ssize_t hex_decode(uint8_t *dst, const char *src, size_t len)
+{
+    if (len & 1)
+        return -1;
+
+    for (size_t i = 0; i < len / 2; i++)
+    {
+        uint8_t hi = hex_values[(uint8_t)src[2 * i]];
+        uint8_t lo = hex_values[(uint8_t)src[2 * i + 1]];
+
+        if (!hi || !lo)
+            return -1;
+
+        dst[i] = (uint8_t)(((hi - 1) << 4) | (lo - 1));
+    }
+
+    return (ssize_t)(len / 2);
+}
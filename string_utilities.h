@@ -1,7 +1,13 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
 char *substring(const char *string, int position, size_t length);
 char *ltrim(char *s);
 char *rtrim(char *s);
-char *trim(char *s);
\ No newline at end of file
+char *trim(char *s);
+size_t hex_encode(char *dst, const uint8_t *src, size_t len);
+ssize_t hex_decode(uint8_t *dst, const char *src, size_t len);